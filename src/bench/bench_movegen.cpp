@@ -0,0 +1,122 @@
+#include "board.h"
+#include "move_kernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+    struct Sample {
+        uint64_t own;
+        uint64_t opp;
+        std::vector<int> moves;
+    };
+
+    template <int N>
+    std::vector<Sample> CollectPositions(int games)
+    {
+        std::mt19937 gen(2024);
+        std::vector<Sample> samples;
+        for (int g = 0; g < games; ++g) {
+            auto board = Board<N>::InitialBoard();
+            Stone stone = Stone::BLACK;
+            while (true) {
+                auto moves = board.GetValidMoves(stone);
+                if (IsEmpty(moves)) {
+                    stone = OpponentStone(stone);
+                    moves = board.GetValidMoves(stone);
+                    if (IsEmpty(moves)) break;
+                }
+                Sample sample;
+                sample.own = stone == Stone::BLACK ? board.black.words[0] : board.white.words[0];
+                sample.opp = stone == Stone::BLACK ? board.white.words[0] : board.black.words[0];
+                ForEachBit(moves, [&](int square) { sample.moves.push_back(square); });
+                samples.push_back(sample);
+                board.PlaceStone(NthBitIndex(moves, static_cast<int>(gen() % CountBits(moves))), stone);
+                stone = OpponentStone(stone);
+            }
+        }
+        return samples;
+    }
+
+    template <class T, class F>
+    double NanosecondsPerCall(const std::vector<T> &samples, int rounds, F &&f)
+    {
+        uint64_t sink = 0;
+        long calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (const auto &sample : samples) {
+                calls += f(sample, sink);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (sink == 42) std::printf(" ");
+        return std::chrono::duration<double, std::nano>(end - start).count() / calls;
+    }
+
+    template <int N>
+    void RunBenchmark(int games, int rounds)
+    {
+        constexpr MoveKernelTable table = MakeMoveKernelTable<N>();
+        auto samples = CollectPositions<N>(games);
+        std::printf("\n%dx%d board, %zu positions x %d rounds\n", N, N, samples.size(), rounds);
+        std::printf("%-16s %14s %14s\n", "kernel", "moves ns/call", "flips ns/call");
+
+        // the boards are built up front, FromMasks also computes the frontier and the hash
+        struct BoardSample {
+            Board<N> board;
+            const Sample *sample;
+        };
+        std::vector<BoardSample> board_samples;
+        for (const auto &sample : samples) {
+            typename Board<N>::Mask black, white;
+            black.words[0] = sample.own;
+            white.words[0] = sample.opp;
+            board_samples.push_back({Board<N>::FromMasks(black, white), &sample});
+        }
+        double board_moves = NanosecondsPerCall(board_samples, rounds, [&](const BoardSample &s, uint64_t &sink) {
+            sink ^= s.board.GetValidMoves(Stone::BLACK).words[0];
+            return 1;
+        });
+        double board_flips = NanosecondsPerCall(board_samples, rounds, [&](const BoardSample &s, uint64_t &sink) {
+            for (int square : s.sample->moves) sink ^= s.board.GetFlips(square, Stone::BLACK).words[0];
+            return static_cast<int>(s.sample->moves.size());
+        });
+        std::printf("%-16s %14.2f %14.2f\n", "Board<N>", board_moves, board_flips);
+        double scalar_moves = NanosecondsPerCall(board_samples, rounds, [&](const BoardSample &s, uint64_t &sink) {
+            sink ^= s.board.GetValidMovesScalar(Stone::BLACK).words[0];
+            return 1;
+        });
+        double scalar_flips = NanosecondsPerCall(board_samples, rounds, [&](const BoardSample &s, uint64_t &sink) {
+            for (int square : s.sample->moves) sink ^= s.board.GetFlipsScalar(square, Stone::BLACK).words[0];
+            return static_cast<int>(s.sample->moves.size());
+        });
+        std::printf("%-16s %14.2f %14.2f\n", "Board<N> scalar", scalar_moves, scalar_flips);
+
+        for (int level = 0; level <= static_cast<int>(DetectSimdLevel()); ++level) {
+            const MoveKernels &kernels = GetMoveKernels(static_cast<SimdLevel>(level));
+            if (static_cast<int>(kernels.level) != level) continue;
+            double moves_ns = NanosecondsPerCall(samples, rounds, [&](const Sample &sample, uint64_t &sink) {
+                sink ^= kernels.valid_moves(sample.own, sample.opp, table);
+                return 1;
+            });
+            double flips_ns = NanosecondsPerCall(samples, rounds, [&](const Sample &sample, uint64_t &sink) {
+                for (int square : sample.moves) sink ^= kernels.flips(square, sample.own, sample.opp, table);
+                return static_cast<int>(sample.moves.size());
+            });
+            std::printf("%-16s %14.2f %14.2f\n", kernels.name, moves_ns, flips_ns);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 20;
+    std::printf("detected simd level: %s\n", GetMoveKernels(DetectSimdLevel()).name);
+    RunBenchmark<8>(2000, rounds);
+    RunBenchmark<6>(2000, rounds);
+    return 0;
+}
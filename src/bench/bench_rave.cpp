@@ -0,0 +1,109 @@
+#include "board.h"
+#include "monte_carlo_tree_search.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <tuple>
+
+namespace {
+    constexpr int opening_plies = 4;
+    constexpr int rave_equivalence = 300;
+
+    struct Player {
+        int simulations;
+        int rave_equivalence;
+        double seconds = 0;
+        int moves = 0;
+    };
+
+    int PickMove(const std::vector<MoveStat> &stats)
+    {
+        auto rank = [](const MoveStat &stat) {
+            return std::make_tuple(stat.proven == Proven::WIN, stat.proven != Proven::LOSS, stat.visit_count);
+        };
+        const MoveStat *best = &stats.front();
+        for (const MoveStat &stat : stats) {
+            if (rank(stat) > rank(*best)) best = &stat;
+        }
+        return best->move;
+    }
+
+    /**
+     * Play one game from a random opening and return the disc difference for the first player.
+     */
+    template <int N>
+    int PlayGame(Player &first, Player &second, bool first_is_black, unsigned seed)
+    {
+        SearchTree<Board<N>> first_tree(seed), second_tree(seed + 1);
+        first_tree.SetRaveEquivalence(first.rave_equivalence);
+        second_tree.SetRaveEquivalence(second.rave_equivalence);
+        std::mt19937 opening_gen(seed);
+        auto board = Board<N>::InitialBoard();
+        Stone stone = Stone::BLACK;
+        for (int ply = 0;; ++ply) {
+            auto moves = board.GetValidMoves(stone);
+            if (IsEmpty(moves)) {
+                stone = OpponentStone(stone);
+                moves = board.GetValidMoves(stone);
+                if (IsEmpty(moves)) break;
+            }
+            int move;
+            if (ply < opening_plies) {
+                move = NthBitIndex(moves, static_cast<int>(opening_gen() % CountBits(moves)));
+            } else {
+                bool first_to_move = (stone == Stone::BLACK) == first_is_black;
+                Player &player = first_to_move ? first : second;
+                auto &tree = first_to_move ? first_tree : second_tree;
+                auto start = std::chrono::steady_clock::now();
+                move = PickMove(tree.Search(board.ToBoardState(), stone, SearchBudget(player.simulations), nullptr));
+                auto end = std::chrono::steady_clock::now();
+                player.seconds += std::chrono::duration<double>(end - start).count();
+                player.moves += 1;
+            }
+            board.MakeMove(move, stone);
+            first_tree.AdvanceRoot(move);
+            second_tree.AdvanceRoot(move);
+            stone = OpponentStone(stone);
+        }
+        Stone first_stone = first_is_black ? Stone::BLACK : Stone::WHITE;
+        return board.CountStone(first_stone) - board.CountStone(OpponentStone(first_stone));
+    }
+
+    /**
+     * RAVE with simulations against plain UCT with multiple times as many, every opening is
+     * played once with each color.
+     */
+    template <int N>
+    void RunMatch(int games, int simulations, int multiple)
+    {
+        Player rave{simulations, rave_equivalence};
+        Player uct{simulations * multiple, 0};
+        double score = 0;
+        for (int g = 0; g < games; ++g) {
+            int diff = PlayGame<N>(rave, uct, g % 2 == 0, static_cast<unsigned>(1000 + g / 2));
+            score += diff > 0 ? 1.0 : (diff == 0 ? 0.5 : 0.0);
+        }
+        std::printf("%8d %8d %10.1f%% %14.2f %14.2f\n", simulations, simulations * multiple, 100.0 * score / games,
+            1000.0 * rave.seconds / rave.moves, 1000.0 * uct.seconds / uct.moves);
+    }
+
+    template <int N>
+    void RunBenchmark(int games, int simulations)
+    {
+        std::printf("\n%dx%d board, %d games per match, rave_equivalence %d\n", N, N, games, rave_equivalence);
+        std::printf("%8s %8s %11s %14s %14s\n", "rave", "uct", "rave score", "rave ms/move", "uct ms/move");
+        for (int multiple : {1, 2, 4}) {
+            RunMatch<N>(games, simulations, multiple);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int games = argc > 1 ? std::atoi(argv[1]) : 40;
+    int simulations = argc > 2 ? std::atoi(argv[2]) : 1000;
+    RunBenchmark<8>(games, simulations);
+    return 0;
+}
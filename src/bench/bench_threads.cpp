@@ -0,0 +1,123 @@
+#include "board.h"
+#include "monte_carlo_tree_search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr int opening_plies = 10;
+
+    /**
+     * Positions after a few random plies from the initial board, the side to move has a legal move.
+     */
+    template <int N>
+    std::vector<std::pair<BoardState, Stone>> CollectPositions(int count)
+    {
+        std::mt19937 gen(2024);
+        std::vector<std::pair<BoardState, Stone>> positions;
+        while (static_cast<int>(positions.size()) < count) {
+            auto board = Board<N>::InitialBoard();
+            Stone stone = Stone::BLACK;
+            bool playing = true;
+            for (int ply = 0; ply < opening_plies && playing; ++ply) {
+                auto moves = board.GetValidMoves(stone);
+                if (IsEmpty(moves)) {
+                    stone = OpponentStone(stone);
+                    moves = board.GetValidMoves(stone);
+                    playing = !IsEmpty(moves);
+                }
+                if (playing) {
+                    board.PlaceStone(NthBitIndex(moves, static_cast<int>(gen() % CountBits(moves))), stone);
+                    stone = OpponentStone(stone);
+                }
+            }
+            if (playing && !IsEmpty(board.GetValidMoves(stone))) {
+                positions.emplace_back(board.ToBoardState(), stone);
+            }
+        }
+        return positions;
+    }
+
+    /**
+     * One tree per thread with the simulations split between them, the way MonteCarloTreeSearch
+     * runs its root parallel workers. Returns simulations per second.
+     */
+    template <int N>
+    double RootParallelRate(const std::vector<std::pair<BoardState, Stone>> &positions, int threads, int simulations)
+    {
+        std::vector<std::unique_ptr<SearchTree<Board<N>>>> trees;
+        for (int i = 0; i < threads; ++i) {
+            trees.push_back(std::make_unique<SearchTree<Board<N>>>(static_cast<unsigned>(i + 1)));
+        }
+        SearchBudget budget = SearchBudget(simulations).Split(threads);
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &[board_state, stone] : positions) {
+            std::vector<std::thread> workers;
+            for (int i = 1; i < threads; ++i) {
+                workers.emplace_back([&, i]() { trees[i]->Search(board_state, stone, budget, nullptr); });
+            }
+            trees[0]->Search(board_state, stone, budget, nullptr);
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        double simulations_run = static_cast<double>(budget.SimulationCount()) * threads * positions.size();
+        return simulations_run / std::chrono::duration<double>(end - start).count();
+    }
+
+    template <int N>
+    double SharedTreeRate(const std::vector<std::pair<BoardState, Stone>> &positions, int threads, int simulations)
+    {
+        SharedSearchTree<Board<N>> tree(threads, 1);
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &[board_state, stone] : positions) {
+            tree.Search(board_state, stone, SearchBudget(simulations), nullptr);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return static_cast<double>(simulations) * positions.size() / std::chrono::duration<double>(end - start).count();
+    }
+
+    template <int N>
+    void RunBenchmark(int num_positions, int simulations, int max_threads)
+    {
+        auto positions = CollectPositions<N>(num_positions);
+        std::vector<int> thread_counts;
+        for (int threads = 1; threads < max_threads; threads *= 2) {
+            thread_counts.push_back(threads);
+        }
+        thread_counts.push_back(max_threads);
+
+        std::printf("\n%dx%d board, %d positions, %d simulations per search, %u hardware threads\n", N, N,
+            num_positions, simulations, std::thread::hardware_concurrency());
+        std::printf("%8s %14s %8s %14s %8s\n", "threads", "root sims/s", "speedup", "shared sims/s", "speedup");
+        // the first pass touches the memory of the pools so the single thread row is not charged for it
+        RootParallelRate<N>(positions, 1, simulations);
+        double root_base = 0, shared_base = 0;
+        for (int threads : thread_counts) {
+            double root_rate = RootParallelRate<N>(positions, threads, simulations);
+            double shared_rate = SharedTreeRate<N>(positions, threads, simulations);
+            if (threads == 1) {
+                root_base = root_rate;
+                shared_base = shared_rate;
+            }
+            std::printf("%8d %14.0f %7.2fx %14.0f %7.2fx\n", threads, root_rate, root_rate / root_base, shared_rate,
+                shared_rate / shared_base);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int positions = argc > 1 ? std::atoi(argv[1]) : 8;
+    int simulations = argc > 2 ? std::atoi(argv[2]) : 40000;
+    int max_threads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+    RunBenchmark<8>(positions, simulations, std::max(1, max_threads));
+    return 0;
+}
@@ -0,0 +1,178 @@
+#ifndef __BIT_MASK_H__
+#define __BIT_MASK_H__
+
+#include <cstdint>
+#include <array>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+inline int CountBits(uint64_t x)
+{
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt64(x));
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+/**
+ * Index of the lowest set bit, x must not be zero.
+ */
+inline int LowestBitIndex(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+inline bool IsEmpty(uint64_t x) { return x == 0; }
+
+inline bool TestBit(uint64_t x, int index) { return (x >> index) & 1; }
+
+inline int PopLowestBit(uint64_t &x)
+{
+    int index = LowestBitIndex(x);
+    x &= x - 1;
+    return index;
+}
+
+/**
+ * Index of the n-th (0 based) set bit.
+ */
+inline int NthBitIndex(uint64_t x, int n)
+{
+    while (n-- > 0) {
+        x &= x - 1;
+    }
+    return LowestBitIndex(x);
+}
+
+/**
+ * x with the bits [0, index] cleared.
+ */
+inline uint64_t ClearBitsThrough(uint64_t x, int index)
+{
+    return index >= 63 ? 0 : x & ~((uint64_t{2} << index) - 1);
+}
+
+template <class F>
+inline void ForEachBit(uint64_t x, F &&f)
+{
+    while (x) {
+        f(PopLowestBit(x));
+    }
+}
+
+/**
+ * Fixed width bit set made of W 64-bit words, bit i lives in words[i / 64].
+ */
+template <int W>
+struct WideMask {
+    std::array<uint64_t, W> words{};
+
+    constexpr WideMask &operator&=(const WideMask &rhs) {
+        for (int i = 0; i < W; ++i) words[i] &= rhs.words[i];
+        return *this;
+    }
+    constexpr WideMask &operator|=(const WideMask &rhs) {
+        for (int i = 0; i < W; ++i) words[i] |= rhs.words[i];
+        return *this;
+    }
+    constexpr WideMask &operator^=(const WideMask &rhs) {
+        for (int i = 0; i < W; ++i) words[i] ^= rhs.words[i];
+        return *this;
+    }
+    friend constexpr WideMask operator&(WideMask lhs, const WideMask &rhs) { return lhs &= rhs; }
+    friend constexpr WideMask operator|(WideMask lhs, const WideMask &rhs) { return lhs |= rhs; }
+    friend constexpr WideMask operator^(WideMask lhs, const WideMask &rhs) { return lhs ^= rhs; }
+    friend constexpr WideMask operator~(WideMask rhs) {
+        for (int i = 0; i < W; ++i) rhs.words[i] = ~rhs.words[i];
+        return rhs;
+    }
+    friend bool operator==(const WideMask &lhs, const WideMask &rhs) { return lhs.words == rhs.words; }
+    friend bool operator!=(const WideMask &lhs, const WideMask &rhs) { return lhs.words != rhs.words; }
+
+    constexpr void Set(int index) { words[index >> 6] |= uint64_t{1} << (index & 63); }
+    constexpr void Reset(int index) { words[index >> 6] &= ~(uint64_t{1} << (index & 63)); }
+
+    static constexpr WideMask Bit(int index) {
+        WideMask mask;
+        mask.Set(index);
+        return mask;
+    }
+};
+
+template <int W>
+inline int CountBits(const WideMask<W> &x)
+{
+    int count = 0;
+    for (int i = 0; i < W; ++i) count += CountBits(x.words[i]);
+    return count;
+}
+
+template <int W>
+inline bool IsEmpty(const WideMask<W> &x)
+{
+    uint64_t any = 0;
+    for (int i = 0; i < W; ++i) any |= x.words[i];
+    return any == 0;
+}
+
+template <int W>
+inline bool TestBit(const WideMask<W> &x, int index)
+{
+    return (x.words[index >> 6] >> (index & 63)) & 1;
+}
+
+template <int W>
+inline int PopLowestBit(WideMask<W> &x)
+{
+    for (int i = 0; i < W; ++i) {
+        if (x.words[i]) {
+            return (i << 6) + PopLowestBit(x.words[i]);
+        }
+    }
+    return -1;
+}
+
+template <int W>
+inline int NthBitIndex(const WideMask<W> &x, int n)
+{
+    for (int i = 0; i < W; ++i) {
+        int count = CountBits(x.words[i]);
+        if (n < count) {
+            return (i << 6) + NthBitIndex(x.words[i], n);
+        }
+        n -= count;
+    }
+    return -1;
+}
+
+template <int W>
+inline WideMask<W> ClearBitsThrough(WideMask<W> x, int index)
+{
+    for (int i = 0; i < (index >> 6); ++i) {
+        x.words[i] = 0;
+    }
+    x.words[index >> 6] = ClearBitsThrough(x.words[index >> 6], index & 63);
+    return x;
+}
+
+template <int W, class F>
+inline void ForEachBit(const WideMask<W> &x, F &&f)
+{
+    for (int i = 0; i < W; ++i) {
+        uint64_t word = x.words[i];
+        while (word) {
+            f((i << 6) + PopLowestBit(word));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,482 @@
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+#include "game_const.h"
+#include "bit_mask.h"
+#include "multi_bitboard.h"
+#include "move_kernels.h"
+#include "zobrist.h"
+
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+namespace board_tables {
+    // direction d is (dx, dy) = directions[d], a step moves square x * N + y by dx * N + dy
+    constexpr int directions[8][2] = {
+        {-1, -1}, {-1, 0}, {-1, 1},
+        {0, -1},           {0, 1},
+        {1, -1},  {1, 0},  {1, 1}
+    };
+
+    template <int N>
+    constexpr int Shift(int d) {
+        return directions[d][0] * N + directions[d][1];
+    }
+
+    /**
+     * Squares that a step in direction d may land on, this drops the bits wrapping around a row.
+     */
+    template <int N, int W>
+    constexpr WideMask<W> DirectionMask(int d) {
+        WideMask<W> mask;
+        for (int x = 0; x < N; ++x) {
+            for (int y = 0; y < N; ++y) {
+                int from_y = y - directions[d][1];
+                if (from_y >= 0 && from_y < N) {
+                    mask.Set(x * N + y);
+                }
+            }
+        }
+        return mask;
+    }
+
+    /**
+     * lengths[square][d] is the number of squares from square to the board edge in direction d,
+     * so the ray walks square + k * Shift<N>(d) for k in [1, lengths[square][d]] need no bounds check.
+     */
+    template <int N>
+    struct RayTable {
+        uint8_t lengths[N * N][8] = {};
+    };
+
+    template <int N>
+    constexpr RayTable<N> MakeRayTable() {
+        RayTable<N> table;
+        for (int x = 0; x < N; ++x) {
+            for (int y = 0; y < N; ++y) {
+                for (int d = 0; d < 8; ++d) {
+                    int length = 0;
+                    int pos_x = x + directions[d][0];
+                    int pos_y = y + directions[d][1];
+                    while (pos_x >= 0 && pos_x < N && pos_y >= 0 && pos_y < N) {
+                        pos_x += directions[d][0];
+                        pos_y += directions[d][1];
+                        ++length;
+                    }
+                    table.lengths[x * N + y][d] = static_cast<uint8_t>(length);
+                }
+            }
+        }
+        return table;
+    }
+
+    template <int N, int W>
+    struct NeighborTable {
+        WideMask<W> masks[N * N];
+    };
+
+    template <int N, int W>
+    constexpr NeighborTable<N, W> MakeNeighborTable() {
+        NeighborTable<N, W> table;
+        for (int x = 0; x < N; ++x) {
+            for (int y = 0; y < N; ++y) {
+                for (const auto &dir : directions) {
+                    int pos_x = x + dir[0];
+                    int pos_y = y + dir[1];
+                    if (pos_x >= 0 && pos_x < N && pos_y >= 0 && pos_y < N) {
+                        table.masks[x * N + y].Set(pos_x * N + pos_y);
+                    }
+                }
+            }
+        }
+        return table;
+    }
+
+    template <int N, int W>
+    constexpr WideMask<W> BoardMask() {
+        WideMask<W> mask;
+        for (int square = 0; square < N * N; ++square) {
+            mask.Set(square);
+        }
+        return mask;
+    }
+}
+
+/**
+ * Position with the board size fixed at compile time, square (x, y) is bit x * N + y.
+ * Direction shifts and edge masks are constexpr tables of each instantiation, so the
+ * move generation loops are fully unrolled for the common sizes.
+ */
+template <int N>
+class Board {
+public:
+    static constexpr int board_size = N;
+    static constexpr int num_words = (N * N + 63) / 64;
+    using Mask = WideMask<num_words>;
+
+    static Board InitialBoard() {
+        Board board;
+        int center = N / 2 - 1;
+        board.black.Set(Square(center, center));
+        board.black.Set(Square(center + 1, center + 1));
+        board.white.Set(Square(center + 1, center));
+        board.white.Set(Square(center, center + 1));
+        board.RebuildIncrementalState();
+        return board;
+    }
+
+    static Board FromMasks(const Mask &black, const Mask &white) {
+        Board board;
+        board.black = black;
+        board.white = white;
+        board.RebuildIncrementalState();
+        return board;
+    }
+
+    static Board FromBoardState(const BoardState &board_state) {
+        Board board;
+        for (int x = 0; x < N; ++x) {
+            for (int y = 0; y < N; ++y) {
+                if (board_state[x][y] == Stone::BLACK) {
+                    board.black.Set(Square(x, y));
+                } else if (board_state[x][y] == Stone::WHITE) {
+                    board.white.Set(Square(x, y));
+                }
+            }
+        }
+        board.RebuildIncrementalState();
+        return board;
+    }
+
+    BoardState ToBoardState() const {
+        BoardState board_state(N, std::vector<Stone>(N, Stone::EMPTY));
+        for (int x = 0; x < N; ++x) {
+            for (int y = 0; y < N; ++y) {
+                board_state[x][y] = GetStone(Square(x, y));
+            }
+        }
+        return board_state;
+    }
+
+    int Size() const { return N; }
+    static constexpr int Square(int x, int y) { return x * N + y; }
+
+    Stone GetStone(int square) const {
+        if (TestBit(black, square)) return Stone::BLACK;
+        if (TestBit(white, square)) return Stone::WHITE;
+        return Stone::EMPTY;
+    }
+
+    Mask GetValidMoves(Stone stone) const {
+        const Mask &own = stone == Stone::BLACK ? black : white;
+        const Mask &opp = stone == Stone::BLACK ? white : black;
+        if constexpr (num_words == 1) {
+            const MoveKernels &kernels = ActiveMoveKernels();
+            if (kernels.level != SimdLevel::SCALAR) {
+                Mask moves;
+                moves.words[0] = kernels.valid_moves(own.words[0], opp.words[0], kernel_table);
+                return moves;
+            }
+        }
+        return GetValidMovesScalar(stone);
+    }
+
+    Mask GetFlips(int square, Stone stone) const {
+        const Mask &own = stone == Stone::BLACK ? black : white;
+        const Mask &opp = stone == Stone::BLACK ? white : black;
+        if constexpr (num_words == 1) {
+            const MoveKernels &kernels = ActiveMoveKernels();
+            if (kernels.level != SimdLevel::SCALAR) {
+                Mask flips;
+                flips.words[0] = kernels.flips(square, own.words[0], opp.words[0], kernel_table);
+                return flips;
+            }
+        }
+        return GetFlipsScalar(square, stone);
+    }
+
+    /**
+     * The portable paths, GetValidMoves and GetFlips fall back to them when no faster kernel is active.
+     */
+    Mask GetValidMovesScalar(Stone stone) const {
+        return stone == Stone::BLACK ? ComputeValidMoves(black, white, frontier)
+                                     : ComputeValidMoves(white, black, frontier);
+    }
+
+    Mask GetFlipsScalar(int square, Stone stone) const {
+        return stone == Stone::BLACK ? ComputeFlips(square, black, white) : ComputeFlips(square, white, black);
+    }
+
+    /**
+     * Squares changed by one placement, UnmakeMove restores the position from it.
+     */
+    struct MoveDelta {
+        Mask flips;
+        Mask frontier;
+        uint64_t hash;
+        int square = -1;
+        Stone stone = Stone::EMPTY;
+    };
+
+    MoveDelta MakeMove(int square, Stone stone) {
+        MoveDelta delta{GetFlips(square, stone), frontier, hash, square, stone};
+        Mask &own = stone == Stone::BLACK ? black : white;
+        Mask &opp = stone == Stone::BLACK ? white : black;
+        own |= delta.flips;
+        opp &= ~delta.flips;
+        own.Set(square);
+        if constexpr (num_words > 1) {
+            int num_flips = CountBits(delta.flips);
+            disc_counts_[StoneIndex(stone)] += num_flips + 1;
+            disc_counts_[1 - StoneIndex(stone)] -= num_flips;
+        }
+        hash ^= zobrist::StoneKey(stone, square) ^ FlipsHash(delta.flips);
+        // flips keep the occupancy, only the empty neighbors of square join the frontier
+        frontier = (frontier | neighbor_table.masks[square]) & ~(black | white);
+        return delta;
+    }
+
+    void UnmakeMove(const MoveDelta &delta) {
+        Mask &own = delta.stone == Stone::BLACK ? black : white;
+        Mask &opp = delta.stone == Stone::BLACK ? white : black;
+        own &= ~delta.flips;
+        own.Reset(delta.square);
+        opp |= delta.flips;
+        frontier = delta.frontier;
+        hash = delta.hash;
+        if constexpr (num_words > 1) {
+            int num_flips = CountBits(delta.flips);
+            disc_counts_[StoneIndex(delta.stone)] -= num_flips + 1;
+            disc_counts_[1 - StoneIndex(delta.stone)] += num_flips;
+        }
+    }
+
+    /**
+     * Zobrist hash of the position with next_move_stone to move.
+     */
+    uint64_t Hash(Stone next_move_stone) const {
+        return hash ^ zobrist::SideKey(next_move_stone);
+    }
+
+    /**
+     * Hash(OpponentStone(stone)) after stone plays square, without making the move.
+     */
+    uint64_t HashAfterMove(int square, Stone stone) const {
+        return hash ^ zobrist::StoneKey(stone, square) ^ FlipsHash(GetFlips(square, stone))
+            ^ zobrist::SideKey(OpponentStone(stone));
+    }
+
+    void PlaceStone(int square, Stone stone) {
+        MakeMove(square, stone);
+    }
+
+    /**
+     * Single word boards count with one popcount, larger boards read the counts kept by MakeMove.
+     */
+    int CountStone(Stone stone) const {
+        if constexpr (num_words == 1) {
+            return CountBits(stone == Stone::BLACK ? black : white);
+        } else {
+            return disc_counts_[StoneIndex(stone)];
+        }
+    }
+
+    Stone GetWinner() const {
+        int black_count = CountStone(Stone::BLACK);
+        int white_count = CountStone(Stone::WHITE);
+        if (black_count == white_count) return Stone::EMPTY;
+        return black_count > white_count ? Stone::BLACK : Stone::WHITE;
+    }
+
+    bool IsGameOver() const {
+        return IsEmpty(GetValidMoves(Stone::BLACK)) && IsEmpty(GetValidMoves(Stone::WHITE));
+    }
+
+    Mask black;
+    Mask white;
+    Mask frontier; // empty squares next to a disc, every legal move is one of them
+    uint64_t hash = 0; // Zobrist hash of the discs, see Hash()
+
+private:
+    void RebuildIncrementalState() {
+        frontier = ComputeFrontier();
+        hash = zobrist::keys.sizes[N];
+        ForEachBit(black, [&](int square) { hash ^= zobrist::StoneKey(Stone::BLACK, square); });
+        ForEachBit(white, [&](int square) { hash ^= zobrist::StoneKey(Stone::WHITE, square); });
+        disc_counts_[0] = CountBits(black);
+        disc_counts_[1] = CountBits(white);
+    }
+
+    static int StoneIndex(Stone stone) {
+        return stone == Stone::WHITE ? 1 : 0;
+    }
+
+    static uint64_t FlipsHash(const Mask &flips) {
+        if constexpr (num_words == 1) {
+            return zobrist::FlipsKey(flips.words[0]);
+        } else {
+            uint64_t result = 0;
+            ForEachBit(flips, [&](int flip) { result ^= zobrist::keys.flips[flip]; });
+            return result;
+        }
+    }
+
+    int disc_counts_[2] = {}; // black, white, kept up to date only when num_words > 1
+
+    struct NoKernelTable {};
+    // single word boards run the SIMD kernels picked at startup, see move_kernels.h
+    static constexpr std::conditional_t<num_words == 1, MoveKernelTable, NoKernelTable> kernel_table = [] {
+        if constexpr (num_words == 1) {
+            return MakeMoveKernelTable<N>();
+        } else {
+            return NoKernelTable{};
+        }
+    }();
+    static constexpr Mask board_mask = board_tables::BoardMask<N, num_words>();
+    static constexpr board_tables::RayTable<N> ray_table = board_tables::MakeRayTable<N>();
+    static constexpr board_tables::NeighborTable<N, num_words> neighbor_table =
+        board_tables::MakeNeighborTable<N, num_words>();
+    static constexpr Mask direction_masks[8] = {
+        board_tables::DirectionMask<N, num_words>(0), board_tables::DirectionMask<N, num_words>(1),
+        board_tables::DirectionMask<N, num_words>(2), board_tables::DirectionMask<N, num_words>(3),
+        board_tables::DirectionMask<N, num_words>(4), board_tables::DirectionMask<N, num_words>(5),
+        board_tables::DirectionMask<N, num_words>(6), board_tables::DirectionMask<N, num_words>(7)
+    };
+
+    template <int S>
+    static Mask Shift(const Mask &x) {
+        Mask result;
+        if constexpr (S > 0) {
+            for (int i = num_words - 1; i > 0; --i) {
+                result.words[i] = (x.words[i] << S) | (x.words[i - 1] >> (64 - S));
+            }
+            result.words[0] = x.words[0] << S;
+        } else {
+            constexpr int s = -S;
+            for (int i = 0; i < num_words - 1; ++i) {
+                result.words[i] = (x.words[i] >> s) | (x.words[i + 1] << (64 - s));
+            }
+            result.words[num_words - 1] = x.words[num_words - 1] >> s;
+        }
+        return result;
+    }
+
+    template <int D>
+    static void AddDirectionMoves(const Mask &own, const Mask &opp, const Mask &candidates, Mask &moves) {
+        constexpr int shift = board_tables::Shift<N>(D);
+        const Mask &dir_mask = direction_masks[D];
+        Mask opp_masked = opp & dir_mask;
+        Mask grown = Shift<shift>(own) & opp_masked;
+        Mask run = grown;
+        for (int step = 0; step < N - 3; ++step) {
+            grown = Shift<shift>(grown) & opp_masked;
+            if constexpr (num_words > 1) {
+                if (IsEmpty(grown)) break;
+            }
+            run |= grown;
+        }
+        moves |= Shift<shift>(run) & dir_mask & candidates;
+    }
+
+    template <int D>
+    static void AddDirectionFlips(const Mask &origin, const Mask &own, const Mask &opp, Mask &flips) {
+        constexpr int shift = board_tables::Shift<N>(D);
+        const Mask &dir_mask = direction_masks[D];
+        Mask line;
+        Mask cursor = Shift<shift>(origin) & dir_mask;
+        while (!IsEmpty(cursor & opp)) {
+            line |= cursor;
+            cursor = Shift<shift>(cursor) & dir_mask;
+        }
+        if (!IsEmpty(cursor & own)) {
+            flips |= line;
+        }
+    }
+
+    template <std::size_t... D>
+    static Mask ComputeValidMoves(const Mask &own, const Mask &opp, const Mask &candidates,
+                                  std::index_sequence<D...>) {
+        Mask moves;
+        (AddDirectionMoves<D>(own, opp, candidates, moves), ...);
+        return moves;
+    }
+
+    static Mask ComputeValidMoves(const Mask &own, const Mask &opp, const Mask &candidates) {
+        return ComputeValidMoves(own, opp, candidates, std::make_index_sequence<8>{});
+    }
+
+    template <std::size_t... D>
+    Mask ComputeFrontier(std::index_sequence<D...>) const {
+        Mask occupied = black | white;
+        Mask around = ((Shift<board_tables::Shift<N>(D)>(occupied) & direction_masks[D]) | ...);
+        return around & ~occupied & board_mask;
+    }
+
+    Mask ComputeFrontier() const {
+        return ComputeFrontier(std::make_index_sequence<8>{});
+    }
+
+    static Mask ComputeFlips(int square, const Mask &own, const Mask &opp) {
+        Mask flips;
+        if constexpr (num_words == 1) {
+            Mask origin = Mask::Bit(square);
+            AddDirectionFlips<0>(origin, own, opp, flips);
+            AddDirectionFlips<1>(origin, own, opp, flips);
+            AddDirectionFlips<2>(origin, own, opp, flips);
+            AddDirectionFlips<3>(origin, own, opp, flips);
+            AddDirectionFlips<4>(origin, own, opp, flips);
+            AddDirectionFlips<5>(origin, own, opp, flips);
+            AddDirectionFlips<6>(origin, own, opp, flips);
+            AddDirectionFlips<7>(origin, own, opp, flips);
+        } else {
+            for (int d = 0; d < 8; ++d) {
+                const int shift = board_tables::Shift<N>(d);
+                const int ray_length = ray_table.lengths[square][d];
+                int pos = square + shift;
+                int length = 0;
+                while (length < ray_length && TestBit(opp, pos)) {
+                    pos += shift;
+                    ++length;
+                }
+                if (length > 0 && length < ray_length && TestBit(own, pos)) {
+                    while (length-- > 0) {
+                        pos -= shift;
+                        flips.Set(pos);
+                    }
+                }
+            }
+        }
+        return flips;
+    }
+};
+
+template <class T>
+struct BoardTag {
+    using type = T;
+};
+
+/**
+ * Call f with the BoardTag of the position type used for board_size: Board<N> for the
+ * specialized sizes, MultiBitBoard for everything else.
+ */
+template <class F>
+decltype(auto) DispatchBoardType(int board_size, F &&f)
+{
+    switch (board_size) {
+        case 6:
+            return f(BoardTag<Board<6>>{});
+        case 8:
+            return f(BoardTag<Board<8>>{});
+        case 10:
+            return f(BoardTag<Board<10>>{});
+        case 12:
+            return f(BoardTag<Board<12>>{});
+        case 16:
+            return f(BoardTag<Board<16>>{});
+        default:
+            return f(BoardTag<MultiBitBoard>{});
+    }
+}
+
+#endif
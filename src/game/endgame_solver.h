@@ -0,0 +1,244 @@
+#ifndef __ENDGAME_SOLVER_H__
+#define __ENDGAME_SOLVER_H__
+
+#include "game_const.h"
+#include "bit_mask.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+constexpr int max_solver_empties = 32;
+// most empty squares the configuration may ask to solve, a root solve of 20 empties on 8x8 takes
+// up to about 5 seconds and every further empty square several times longer
+constexpr int max_config_solver_empties = 20;
+
+/**
+ * When a limited EndgameSolver search gives up: after max_nodes positions, 0 for no limit, or
+ * once the deadline passes or stop is set. The clock and the flag are read every check_interval
+ * positions.
+ */
+struct SolverLimits {
+    static constexpr uint64_t check_interval = 1024;
+
+    uint64_t max_nodes = 0;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    const std::atomic<bool> *stop = nullptr;
+};
+
+/**
+ * Exact negamax with alpha-beta over the final disc difference, for positions with few empty
+ * squares. Moves leaving the opponent the fewest replies are tried first, corners before the rest,
+ * and a table keyed by Hash() keeps the bounds and best move of positions already searched. The
+ * bounds are exact, so the table stays valid between searches of one game.
+ */
+template <class Board>
+class EndgameSolver {
+public:
+    /**
+     * table_size is rounded up to a power of two.
+     */
+    explicit EndgameSolver(uint32_t table_size = 1 << 16) {
+        uint32_t capacity = 1;
+        while (capacity < table_size) {
+            capacity *= 2;
+        }
+        table_.assign(capacity, Entry{});
+    }
+
+    static int Empties(const Board &board) {
+        return board.Size() * board.Size() - board.CountStone(Stone::BLACK) - board.CountStone(Stone::WHITE);
+    }
+
+    /**
+     * Disc difference for next_move_stone at the end of the game with best play, clamped to
+     * [alpha, beta] in the fail-soft sense, or nullopt when limits stop the search first. board has
+     * at most max_solver_empties empty squares and is restored on return. Positions searched to the
+     * end stay in the table, so solving again continues from them.
+     */
+    std::optional<int> Solve(Board &board, Stone next_move_stone, int alpha, int beta, const SolverLimits &limits) {
+        limits_ = &limits;
+        num_nodes_ = 0;
+        aborted_ = false;
+        int score = Negamax(board, next_move_stone, alpha, beta, false);
+        limits_ = nullptr;
+        if (aborted_) {
+            return std::nullopt;
+        }
+        return score;
+    }
+
+    /**
+     * Winner with best play from both sides, EMPTY for a draw, nullopt when limits stop the search first.
+     */
+    std::optional<Stone> SolveWinner(Board &board, Stone next_move_stone, const SolverLimits &limits) {
+        std::optional<int> score = Solve(board, next_move_stone, -1, 1, limits);
+        if (!score.has_value()) {
+            return std::nullopt;
+        }
+        return WinnerOf(*score, next_move_stone);
+    }
+
+private:
+    static constexpr int16_t no_move = -1;
+    // shallower positions are cheaper to search again than to look up
+    static constexpr int table_min_empties = 6;
+    // below this many empties the moves are tried in square order, ordering costs more than it saves
+    static constexpr int ordering_min_empties = 7;
+
+    struct Entry {
+        uint64_t key = 0; // 0 marks an empty entry
+        int16_t lower = 0;
+        int16_t upper = 0;
+        int16_t best_move = no_move;
+    };
+
+    static Stone WinnerOf(int score, Stone next_move_stone) {
+        if (score == 0) {
+            return Stone::EMPTY;
+        }
+        return score > 0 ? next_move_stone : OpponentStone(next_move_stone);
+    }
+
+    /**
+     * Count a position against limits_ and tell whether the search should give up.
+     */
+    bool LimitReached() {
+        if (aborted_) {
+            return true;
+        }
+        ++num_nodes_;
+        if (limits_->max_nodes > 0 && num_nodes_ > limits_->max_nodes) {
+            aborted_ = true;
+        } else if (num_nodes_ % SolverLimits::check_interval == 0) {
+            aborted_ = (limits_->stop != nullptr && limits_->stop->load(std::memory_order_relaxed))
+                || (limits_->deadline.has_value() && std::chrono::steady_clock::now() >= *limits_->deadline);
+        }
+        return aborted_;
+    }
+
+    int FinalScore(const Board &board, Stone stone) const {
+        return board.CountStone(stone) - board.CountStone(OpponentStone(stone));
+    }
+
+    /**
+     * Returns 0 once limits_ are reached, aborted_ tells the callers to unwind without storing
+     * anything.
+     */
+    int Negamax(Board &board, Stone stone, int alpha, int beta, bool passed) {
+        if (LimitReached()) {
+            return 0;
+        }
+        auto valid_moves = board.GetValidMoves(stone);
+        if (IsEmpty(valid_moves)) {
+            if (passed) {
+                return FinalScore(board, stone);
+            }
+            return -Negamax(board, OpponentStone(stone), -beta, -alpha, true);
+        }
+
+        const int empties = Empties(board);
+        Entry *entry = nullptr;
+        int16_t hint_move = no_move;
+        if (empties >= table_min_empties) {
+            uint64_t key = board.Hash(stone);
+            entry = &table_[key & (table_.size() - 1)];
+            if (entry->key == key) {
+                if (entry->lower >= beta) {
+                    return entry->lower;
+                }
+                if (entry->upper <= alpha) {
+                    return entry->upper;
+                }
+                if (entry->lower == entry->upper) {
+                    return entry->lower;
+                }
+                hint_move = entry->best_move;
+            }
+        }
+
+        int moves[max_solver_empties];
+        int num_moves = 0;
+        while (!IsEmpty(valid_moves)) {
+            moves[num_moves++] = PopLowestBit(valid_moves);
+        }
+        if (empties >= ordering_min_empties && num_moves > 1) {
+            OrderMoves(board, stone, moves, num_moves, hint_move);
+        }
+
+        const int original_alpha = alpha;
+        int best_score = -(1 << 15);
+        int best_move = no_move;
+        for (int i = 0; i < num_moves; ++i) {
+            auto delta = board.MakeMove(moves[i], stone);
+            int score = -Negamax(board, OpponentStone(stone), -beta, -alpha, false);
+            board.UnmakeMove(delta);
+            if (aborted_) {
+                return 0;
+            }
+            if (score > best_score) {
+                best_score = score;
+                best_move = moves[i];
+                if (score > alpha) {
+                    alpha = score;
+                    if (alpha >= beta) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (entry != nullptr) {
+            entry->key = board.Hash(stone);
+            entry->lower = static_cast<int16_t>(best_score > original_alpha ? best_score : -(1 << 15));
+            entry->upper = static_cast<int16_t>(best_score < beta ? best_score : (1 << 15) - 1);
+            entry->best_move = static_cast<int16_t>(best_move);
+        }
+        return best_score;
+    }
+
+    /**
+     * The table's best move first, then by fewest opponent replies with corners ahead.
+     */
+    void OrderMoves(Board &board, Stone stone, int *moves, int num_moves, int16_t hint_move) {
+        const int size = board.Size();
+        const int last = size - 1;
+        int keys[max_solver_empties];
+        for (int i = 0; i < num_moves; ++i) {
+            int square = moves[i];
+            if (square == hint_move) {
+                keys[i] = -(1 << 20);
+                continue;
+            }
+            auto delta = board.MakeMove(square, stone);
+            keys[i] = CountBits(board.GetValidMoves(OpponentStone(stone))) * 4;
+            board.UnmakeMove(delta);
+            int x = square / size;
+            int y = square % size;
+            if ((x == 0 || x == last) && (y == 0 || y == last)) {
+                keys[i] -= 8;
+            }
+        }
+        // insertion sort, there are rarely more than a dozen moves
+        for (int i = 1; i < num_moves; ++i) {
+            int move = moves[i];
+            int key = keys[i];
+            int j = i - 1;
+            for (; j >= 0 && keys[j] > key; --j) {
+                moves[j + 1] = moves[j];
+                keys[j + 1] = keys[j];
+            }
+            moves[j + 1] = move;
+            keys[j + 1] = key;
+        }
+    }
+
+    std::vector<Entry> table_;
+    const SolverLimits *limits_ = nullptr; // set while Solve runs
+    uint64_t num_nodes_ = 0;
+    bool aborted_ = false;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef __GAME_CONST_H__
 #define __GAME_CONST_H__
 
+#include <vector>
+
 enum class Stone
 {
     EMPTY = 0,
@@ -8,4 +10,11 @@ enum class Stone
     WHITE = 2
 };
 
-#endif
\ No newline at end of file
+using BoardState = std::vector<std::vector<Stone>>;
+
+inline Stone OpponentStone(Stone stone)
+{
+    return stone == Stone::WHITE ? Stone::BLACK : Stone::WHITE;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include "game_history.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+void UnmakePlacementStone(BoardState &board_state, const PlacementDelta &delta)
+{
+    int board_size = static_cast<int>(board_state.size());
+    Stone opp_stone = OpponentStone(delta.place_stone);
+    board_state[delta.place_x][delta.place_y] = Stone::EMPTY;
+    ForEachBit(delta.flips, [&](int square) {
+        board_state[square / board_size][square % board_size] = opp_stone;
+    });
+}
+
+void GameHistory::Reset(const BoardState &initial_state)
+{
+    board_size_ = static_cast<int>(initial_state.size());
+    snapshot_words_ = (board_size_ * board_size_ + 31) / 32;
+    current_ply_ = 0;
+    records_.clear();
+    flip_squares_.clear();
+    snapshots_.clear();
+    SaveSnapshot(initial_state);
+}
+
+void GameHistory::Push(const BoardState &board_state, const PlacementDelta &delta)
+{
+    if (current_ply_ < NumPlies()) {
+        flip_squares_.resize(records_[current_ply_].flips_begin);
+        records_.resize(current_ply_);
+        snapshots_.resize(static_cast<size_t>(current_ply_ / snapshot_interval + 1) * snapshot_words_);
+    }
+    Record record;
+    record.square = static_cast<uint16_t>(delta.place_x * board_size_ + delta.place_y);
+    record.place_stone = static_cast<uint8_t>(delta.place_stone);
+    record.flips_begin = static_cast<uint32_t>(flip_squares_.size());
+    records_.push_back(record);
+    ForEachBit(delta.flips, [&](int square) {
+        flip_squares_.push_back(static_cast<uint16_t>(square));
+    });
+    ++current_ply_;
+    if (current_ply_ % snapshot_interval == 0) {
+        SaveSnapshot(board_state);
+    }
+}
+
+GameHistory::Move GameHistory::GetMove(int ply) const
+{
+    const Record &record = records_[ply];
+    return {record.square / board_size_, record.square % board_size_, record.PlaceStone()};
+}
+
+void GameHistory::GoToPly(int ply, BoardState &board_state)
+{
+    if (ply < 0 || ply > NumPlies()) {
+        throw std::runtime_error("history ply out of range");
+    }
+    int snapshot_index = ply / snapshot_interval;
+    int snapshot_ply = snapshot_index * snapshot_interval;
+    if (std::abs(ply - current_ply_) > ply - snapshot_ply) {
+        LoadSnapshot(snapshot_index, board_state);
+        current_ply_ = snapshot_ply;
+    }
+    while (current_ply_ < ply) {
+        Redo(board_state);
+    }
+    while (current_ply_ > ply) {
+        Undo(board_state);
+    }
+}
+
+uint32_t GameHistory::FlipsEnd(int ply) const
+{
+    return ply + 1 < NumPlies() ? records_[ply + 1].flips_begin : static_cast<uint32_t>(flip_squares_.size());
+}
+
+PlacementDelta GameHistory::GetDelta(int ply) const
+{
+    const Record &record = records_[ply];
+    PlacementDelta delta;
+    delta.place_x = record.square / board_size_;
+    delta.place_y = record.square % board_size_;
+    delta.place_stone = record.PlaceStone();
+    for (uint32_t i = record.flips_begin; i < FlipsEnd(ply); ++i) {
+        delta.flips.Set(flip_squares_[i]);
+    }
+    return delta;
+}
+
+void GameHistory::Undo(BoardState &board_state)
+{
+    --current_ply_;
+    UnmakePlacementStone(board_state, GetDelta(current_ply_));
+}
+
+void GameHistory::Redo(BoardState &board_state)
+{
+    const Record &record = records_[current_ply_];
+    board_state[record.square / board_size_][record.square % board_size_] = record.PlaceStone();
+    for (uint32_t i = record.flips_begin; i < FlipsEnd(current_ply_); ++i) {
+        board_state[flip_squares_[i] / board_size_][flip_squares_[i] % board_size_] = record.PlaceStone();
+    }
+    ++current_ply_;
+}
+
+void GameHistory::SaveSnapshot(const BoardState &board_state)
+{
+    size_t offset = snapshots_.size();
+    snapshots_.resize(offset + snapshot_words_, 0);
+    for (int x = 0; x < board_size_; ++x) {
+        for (int y = 0; y < board_size_; ++y) {
+            int square = x * board_size_ + y;
+            snapshots_[offset + square / 32] |= static_cast<uint64_t>(board_state[x][y]) << (square % 32 * 2);
+        }
+    }
+}
+
+void GameHistory::LoadSnapshot(int index, BoardState &board_state) const
+{
+    const uint64_t *packed = snapshots_.data() + static_cast<size_t>(index) * snapshot_words_;
+    for (int x = 0; x < board_size_; ++x) {
+        for (int y = 0; y < board_size_; ++y) {
+            int square = x * board_size_ + y;
+            board_state[x][y] = static_cast<Stone>((packed[square / 32] >> (square % 32 * 2)) & 3);
+        }
+    }
+}
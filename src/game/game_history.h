@@ -0,0 +1,83 @@
+#ifndef __GAME_HISTORY_H__
+#define __GAME_HISTORY_H__
+
+#include "game_const.h"
+#include "bit_mask.h"
+#include "multi_bitboard.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * One placement on a board_state, flips has bit x * board_size + y set for every disc turned over.
+ */
+struct PlacementDelta {
+    int place_x = -1;
+    int place_y = -1;
+    Stone place_stone = Stone::EMPTY;
+    MultiBitBoard::Mask flips;
+};
+
+/**
+ * Take a placement back: the square is emptied and the flipped discs return to the opponent.
+ */
+void UnmakePlacementStone(BoardState &board_state, const PlacementDelta &delta);
+
+/**
+ * Moves of one game for undo and redo. A ply keeps its square, stone and flipped squares, the
+ * flipped squares of all plies share one pool. Every snapshot_interval plies the board is also
+ * stored packed at 2 bits per square, so any ply is reached by replaying at most
+ * snapshot_interval plies, either from the current ply or from the nearest snapshot.
+ */
+class GameHistory {
+public:
+    static constexpr int snapshot_interval = 16;
+
+    struct Move {
+        int place_x;
+        int place_y;
+        Stone place_stone;
+    };
+
+    void Reset(const BoardState &initial_state);
+
+    /**
+     * Record the move just made on board_state at the current ply, plies after it are dropped.
+     */
+    void Push(const BoardState &board_state, const PlacementDelta &delta);
+
+    int CurrentPly() const { return current_ply_; }
+    int NumPlies() const { return static_cast<int>(records_.size()); }
+    Move GetMove(int ply) const;
+
+    /**
+     * Bring board_state from the current ply to ply, which is in [0, NumPlies()].
+     */
+    void GoToPly(int ply, BoardState &board_state);
+
+private:
+    struct Record {
+        uint16_t square;
+        uint8_t place_stone; // a Stone, stored narrow so a record packs into 8 bytes
+        uint32_t flips_begin; // flips are flip_squares_[flips_begin, next record's flips_begin)
+
+        Stone PlaceStone() const { return static_cast<Stone>(place_stone); }
+    };
+    static_assert(sizeof(Record) == 8, "a history record should stay 8 bytes");
+
+    uint32_t FlipsEnd(int ply) const;
+    PlacementDelta GetDelta(int ply) const;
+    void Undo(BoardState &board_state);
+    void Redo(BoardState &board_state);
+    void SaveSnapshot(const BoardState &board_state);
+    void LoadSnapshot(int index, BoardState &board_state) const;
+
+    int board_size_ = 0;
+    int snapshot_words_ = 0;
+    int current_ply_ = 0;
+    std::vector<Record> records_;
+    std::vector<uint16_t> flip_squares_;
+    std::vector<uint64_t> snapshots_; // snapshot k is the board at ply k * snapshot_interval
+};
+
+#endif
@@ -132,11 +132,12 @@ void GameUI::DrawBoard(ReversiGame &game, const ImVec2 &left_top_pos, const ImVe
     }
 
     // draw hint last move
-    if (game.record_move_.empty()) {
+    if (game.history_.CurrentPly() == 0) {
         return;
     }
-    ImVec2 hint_center_pos(left_top_pos.x + line_interval * (game.record_move_.back().first + 0.5),
-                           left_top_pos.y + line_interval * (game.record_move_.back().second + 0.5));
+    auto last_move = game.history_.GetMove(game.history_.CurrentPly() - 1);
+    ImVec2 hint_center_pos(left_top_pos.x + line_interval * (last_move.place_x + 0.5),
+                           left_top_pos.y + line_interval * (last_move.place_y + 0.5));
     float hint_rect_half_size = 5.0f;
     draw_list->AddRectFilled(
         ImVec2(hint_center_pos.x - hint_rect_half_size, hint_center_pos.y - hint_rect_half_size),
@@ -147,7 +148,7 @@ void GameUI::DrawBoard(ReversiGame &game, const ImVec2 &left_top_pos, const ImVe
 std::pair<ImVec2, ImVec2>  GameUI::DrawMainPanel(ReversiGame &game)
 {
     auto &io = ImGui::GetIO();
-    ImVec2 win_sz(std::min<float>(200.0f, io.DisplaySize.x * 0.3f), std::min<float>(285.0f, io.DisplaySize.y*0.66f));
+    ImVec2 win_sz(std::min<float>(200.0f, io.DisplaySize.x * 0.3f), std::min<float>(320.0f, io.DisplaySize.y*0.66f));
     ImVec2 win_pos(10, 10);
     ImGui::SetNextWindowSize(win_sz, ImGuiCond_Always);
     ImGui::SetNextWindowPos(win_pos);
@@ -187,6 +188,10 @@ std::pair<ImVec2, ImVec2>  GameUI::DrawMainPanel(ReversiGame &game)
     if (ImGui::Button("withdraw a move", btn_sz)) {
         game.WithdrawAMove();
     }
+    ImGui::SetCursorPosX((win_sz.x - btn_sz.x) * 0.5f);
+    if (ImGui::Button("redo a move", btn_sz)) {
+        game.RedoAMove();
+    }
     ImGui::Text("AI search itr steps: ");
     ImGui::InputInt("##itr_steps", &game.monte_carlo_iter_steps_);
     ImGui::Text("Player use %s stone.", game.this_game_player_first ? "black" : "white");
@@ -1,260 +1,1488 @@
 #include "monte_carlo_tree_search.h"
-#include "reversi_game.h"
+#include "board.h"
 #include "tqdm.h"
 
 #include <random>
 #include <iostream>
 #include <chrono>
 #include <functional>
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
 
-namespace {
-//    std::mt19937 gen(std::random_device{}());
-    std::default_random_engine gen;
-}
+#if defined(__SSE2__) || defined(_M_X64)
+#define REVERSI_UCB_SSE2 1
+#include <emmintrin.h>
+#endif
 
-std::vector<std::pair<int, int>> GetEmptyPos(const GameState &board_state) {
-    std::vector<std::pair<int, int>> empty_pos;
-    for (int i = 0; i < board_state.size(); ++i) {
-        for (int j = 0; j < board_state[i].size(); ++j) {
-            if (board_state[i][j] == Stone::EMPTY) {
-                empty_pos.emplace_back(i, j);
+uint32_t UcbArgmax(const uint32_t *visit_counts, const uint32_t *half_wins, const Proven *proven, uint32_t count,
+    double exploration)
+{
+    const float scale = static_cast<float>(exploration);
+    uint32_t best = 0;
+    float best_priority = -std::numeric_limits<float>::infinity();
+    uint32_t i = 0;
+#ifdef REVERSI_UCB_SSE2
+    if (count >= 4) {
+        // lane k keeps the best of children k, k + 4, k + 8, ..., strict comparisons keep the first
+        const __m128 scale4 = _mm_set1_ps(scale);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        const __m128 zero = _mm_setzero_ps();
+        const __m128i zero_i = _mm_setzero_si128();
+        __m128 best_priority4 = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+        __m128i best4 = _mm_setzero_si128();
+        __m128i index4 = _mm_set_epi32(3, 2, 1, 0);
+        const __m128i step = _mm_set1_epi32(4);
+        for (; i + 4 <= count; i += 4) {
+            __m128 visits = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(visit_counts + i)));
+            __m128 wins = _mm_mul_ps(half,
+                _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(half_wins + i))));
+            __m128 priority = _mm_div_ps(_mm_add_ps(wins, _mm_mul_ps(scale4, _mm_sqrt_ps(visits))), visits);
+            __m128 unvisited = _mm_cmpeq_ps(visits, zero);
+            priority = _mm_or_ps(_mm_andnot_ps(unvisited, priority), _mm_and_ps(unvisited, inf));
+            // widen the four proven bytes to lanes, a proven child can not beat the initial -inf
+            int32_t proven_bytes;
+            std::memcpy(&proven_bytes, proven + i, sizeof(proven_bytes));
+            __m128i proven4 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(proven_bytes), zero_i), zero_i);
+            __m128 skipped = _mm_castsi128_ps(_mm_cmpgt_epi32(proven4, zero_i));
+            priority = _mm_andnot_ps(skipped, priority);
+            priority = _mm_or_ps(priority, _mm_and_ps(skipped, _mm_set1_ps(-std::numeric_limits<float>::infinity())));
+            __m128 greater = _mm_cmpgt_ps(priority, best_priority4);
+            __m128i greater_i = _mm_castps_si128(greater);
+            best_priority4 = _mm_or_ps(_mm_andnot_ps(greater, best_priority4), _mm_and_ps(greater, priority));
+            best4 = _mm_or_si128(_mm_andnot_si128(greater_i, best4), _mm_and_si128(greater_i, index4));
+            index4 = _mm_add_epi32(index4, step);
+        }
+        alignas(16) float lane_priorities[4];
+        alignas(16) uint32_t lane_indices[4];
+        _mm_store_ps(lane_priorities, best_priority4);
+        _mm_store_si128(reinterpret_cast<__m128i *>(lane_indices), best4);
+        best = lane_indices[0];
+        best_priority = lane_priorities[0];
+        for (int k = 1; k < 4; ++k) {
+            if (lane_priorities[k] > best_priority
+                || (lane_priorities[k] == best_priority && lane_indices[k] < best)) {
+                best_priority = lane_priorities[k];
+                best = lane_indices[k];
             }
         }
     }
-    return empty_pos;
+#endif
+    for (; i < count; ++i) {
+        if (proven[i] != Proven::NONE) {
+            continue;
+        }
+        float visits = static_cast<float>(visit_counts[i]);
+        float priority = visit_counts[i] == 0 ? std::numeric_limits<float>::infinity()
+            : (0.5f * static_cast<float>(half_wins[i]) + scale * std::sqrt(visits)) / visits;
+        if (priority > best_priority) {
+            best_priority = priority;
+            best = i;
+        }
+    }
+    return best;
 }
 
-bool CheckPositionValidMove(Stone player_stone, const GameState &board_state, const std::pair<int, int> &pos) {
-    Stone opponent_stone = ReversiGame::GetOpponentStone(player_stone);
-    const std::vector<std::pair<int, int>> directions{
-        {-1, -1}, {-1, 0}, {-1, 1},
-        {0, -1},          {0, 1},
-        {1, -1},  {1, 0},  {1, 1}
+namespace {
+    /**
+     * Squares of one board size split into classes for PlayoutPolicy::WEIGHTED: corners, other edge
+     * squares, inner squares, and the edge (C) and diagonal (X) neighbors of corners, which hand
+     * the corner to the opponent.
+     */
+    template <class Mask>
+    struct SquareClasses {
+        static constexpr int num_classes = 5;
+        static constexpr uint32_t weights[num_classes] = {32, 6, 3, 1, 1};
+        Mask masks[num_classes];
     };
-    for (const auto &dir : directions) {
-        int nx = pos.first + dir.first;
-        int ny = pos.second + dir.second;
-        bool has_opponent_stone_between = false;
-        while (nx >= 0 && nx < board_state.size() && ny >= 0 && ny < board_state.size()) {
-            if (board_state[nx][ny] == opponent_stone) {
-                has_opponent_stone_between = true;
-            } else if (board_state[nx][ny] == player_stone) {
-                if (has_opponent_stone_between) {
-                    return true;
+
+    template <class Mask>
+    SquareClasses<Mask> MakeSquareClasses(int board_size)
+    {
+        SquareClasses<Mask> classes;
+        const int last = board_size - 1;
+        auto near_corner = [&](int v) { return v == 1 || v == last - 1; };
+        auto at_edge = [&](int v) { return v == 0 || v == last; };
+        for (int x = 0; x < board_size; ++x) {
+            for (int y = 0; y < board_size; ++y) {
+                int square_class = 2;
+                if (at_edge(x) && at_edge(y)) {
+                    square_class = 0;
+                } else if ((at_edge(x) && near_corner(y)) || (near_corner(x) && at_edge(y))) {
+                    square_class = 3;
+                } else if (near_corner(x) && near_corner(y)) {
+                    square_class = 4;
+                } else if (at_edge(x) || at_edge(y)) {
+                    square_class = 1;
                 }
-                break;
+                classes.masks[square_class].Set(x * board_size + y);
+            }
+        }
+        return classes;
+    }
+
+    template <class Mask>
+    const SquareClasses<Mask> &GetSquareClasses(int board_size)
+    {
+        constexpr int max_size = MultiBitBoard::max_board_size;
+        static const auto tables = [] {
+            const int max_squares = 64 * static_cast<int>(Mask{}.words.size());
+            std::vector<SquareClasses<Mask>> result(max_size + 1);
+            for (int size = 4; size <= max_size && size * size <= max_squares; ++size) {
+                result[size] = MakeSquareClasses<Mask>(size);
+            }
+            return result;
+        }();
+        return tables[board_size];
+    }
+
+    /**
+     * Legal move drawn in proportion to the weight of its square class, one popcount per class
+     * picks the class and the move is uniform within it.
+     */
+    template <class Mask>
+    int SampleWeightedMove(const Mask &valid_moves, const SquareClasses<Mask> &classes,
+                           std::default_random_engine &gen)
+    {
+        using Classes = SquareClasses<Mask>;
+        uint32_t class_weights[Classes::num_classes];
+        uint32_t total_weight = 0;
+        for (int k = 0; k < Classes::num_classes; ++k) {
+            class_weights[k] = CountBits(valid_moves & classes.masks[k]) * Classes::weights[k];
+            total_weight += class_weights[k];
+        }
+        uint32_t r = static_cast<uint32_t>(gen() % total_weight);
+        int k = 0;
+        while (r >= class_weights[k]) {
+            r -= class_weights[k];
+            ++k;
+        }
+        return NthBitIndex(valid_moves & classes.masks[k], static_cast<int>(r / Classes::weights[k]));
+    }
+
+    // the AMAF values already spread the visits over the moves, so RAVE selection keeps this share
+    // of the UCB1 exploration, tuned in self-play on 8x8
+    constexpr double rave_exploration_scale = 0.25;
+
+    /**
+     * Offset of the highest RAVE priority among the count children from first_child: UCB1 with the
+     * exploration scaled by rave_exploration_scale and the mean result of a child of n visits
+     * replaced by (1 - beta) times it plus beta times its AMAF mean, beta = sqrt(k / (3 n + k)) for
+     * rave_equivalence k. An unvisited child is ranked by its AMAF mean alone with the exploration
+     * of one visit, ahead of the others while it has no AMAF playouts either. Proven children are
+     * skipped as in UcbArgmax.
+     */
+    uint32_t RaveArgmax(const NodePool &nodes, uint32_t first_child, uint32_t count, double exploration,
+                        int rave_equivalence)
+    {
+        const uint32_t *visit_counts = nodes.VisitCounts() + first_child;
+        const uint32_t *half_wins = nodes.HalfWins() + first_child;
+        const uint32_t *amaf_visit_counts = nodes.AmafVisitCounts() + first_child;
+        const uint32_t *amaf_half_wins = nodes.AmafHalfWins() + first_child;
+        const Proven *proven = nodes.ProvenValues() + first_child;
+        const double k = rave_equivalence;
+        exploration *= rave_exploration_scale;
+        uint32_t best = 0;
+        double best_priority = -std::numeric_limits<double>::infinity();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (proven[i] != Proven::NONE) {
+                continue;
+            }
+            double priority;
+            if (visit_counts[i] == 0) {
+                priority = (amaf_visit_counts[i] == 0 ? 2.0 : 0.5 * amaf_half_wins[i] / amaf_visit_counts[i])
+                    + exploration;
             } else {
+                double visits = visit_counts[i];
+                double mean = 0.5 * half_wins[i] / visits;
+                double amaf_mean = amaf_visit_counts[i] == 0 ? mean
+                    : 0.5 * amaf_half_wins[i] / amaf_visit_counts[i];
+                double beta = std::sqrt(k / (3.0 * visits + k));
+                priority = (1.0 - beta) * mean + beta * amaf_mean + exploration / std::sqrt(visits);
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Default playout callback of SimulateBatch, see there.
+     */
+    struct IgnorePlayout {
+        void operator()(Stone, uint32_t) const {}
+    };
+
+    /**
+     * Play moves picked by policy on board until the game ends and return the winner, the moves
+     * are appended to move_deltas for UnmakeMoves.
+     */
+    template <class Board>
+    Stone Simulate(Board &board, Stone next_move_stone, PlayoutPolicy policy,
+                   std::vector<typename Board::MoveDelta> &move_deltas, std::default_random_engine &gen)
+    {
+        using Mask = typename Board::Mask;
+        const SquareClasses<Mask> &classes = GetSquareClasses<Mask>(board.Size());
+        auto cur_move_stone = next_move_stone;
+        while(true) {
+            auto valid_moves = board.GetValidMoves(cur_move_stone);
+            if (IsEmpty(valid_moves)) {
+                cur_move_stone = OpponentStone(cur_move_stone);
+                valid_moves = board.GetValidMoves(cur_move_stone);
+                if (IsEmpty(valid_moves)) {
+                    return board.GetWinner();
+                }
+            }
+            int move = policy == PlayoutPolicy::WEIGHTED ? SampleWeightedMove(valid_moves, classes, gen)
+                : NthBitIndex(valid_moves, static_cast<int>(gen() % CountBits(valid_moves)));
+            move_deltas.push_back(board.MakeMove(move, cur_move_stone));
+            cur_move_stone = OpponentStone(cur_move_stone);
+        }
+    }
+
+    /**
+     * Take back the moves in move_deltas after the first depth ones, with depth 0 this brings
+     * board back to the search root.
+     */
+    template <class Board>
+    void UnmakeMoves(Board &board, std::vector<typename Board::MoveDelta> &move_deltas, size_t depth = 0)
+    {
+        while (move_deltas.size() > depth) {
+            board.UnmakeMove(move_deltas.back());
+            move_deltas.pop_back();
+        }
+    }
+
+    /**
+     * Run count playouts from board and collect the winners. The selection cost of the leaf is
+     * paid once for the whole batch, board is back at the leaf between playouts. on_playout(winner,
+     * times) sees every playout while its moves are still in move_deltas.
+     */
+    template <class Board, class OnPlayout = IgnorePlayout>
+    PlayoutResults SimulateBatch(Board &board, Stone next_move_stone, int count, PlayoutPolicy policy,
+                                 std::vector<typename Board::MoveDelta> &move_deltas, std::default_random_engine &gen,
+                                 OnPlayout on_playout = OnPlayout{})
+    {
+        PlayoutResults results;
+        size_t leaf_depth = move_deltas.size();
+        for (int i = 0; i < count; ++i) {
+            Stone winner = Simulate(board, next_move_stone, policy, move_deltas, gen);
+            if (move_deltas.size() == leaf_depth) {
+                // no move was played, the leaf ends the game and every playout returns its winner
+                results.Add(winner, count - i);
+                results.exact = true;
+                on_playout(winner, count - i);
                 break;
             }
-            nx += dir.first;
-            ny += dir.second;
+            results.Add(winner);
+            on_playout(winner, 1);
+            UnmakeMoves(board, move_deltas, leaf_depth);
         }
+        return results;
     }
-    return false;
-}
 
-std::vector<std::pair<int, int>> GetValidMovesFromHint(Stone player_stone, const GameState &board_state,
-    const std::set<std::pair<int, int>> &empty_pos) {
-    std::vector<std::pair<int, int>> valid_moves;
-    for (const auto &pos : empty_pos) {
-        if (CheckPositionValidMove(player_stone, board_state, pos)) {
-            valid_moves.emplace_back(pos);
+    /**
+     * Results of a new leaf, solved exactly when it has at most solver_empties empty squares and
+     * played out count times otherwise or when solver_limits stop the solver. A solved leaf counts
+     * as count playouts with its winner.
+     */
+    template <class Board, class OnPlayout = IgnorePlayout>
+    PlayoutResults EvaluateLeaf(Board &board, Stone next_move_stone, int count, int solver_empties,
+                                std::optional<EndgameSolver<Board>> &solver, const SolverLimits &solver_limits,
+                                PlayoutPolicy policy, std::vector<typename Board::MoveDelta> &move_deltas,
+                                std::default_random_engine &gen, OnPlayout on_playout = OnPlayout{})
+    {
+        if (solver_empties > 0 && EndgameSolver<Board>::Empties(board) <= solver_empties) {
+            if (!solver.has_value()) {
+                solver.emplace();
+            }
+            std::optional<Stone> winner = solver->SolveWinner(board, next_move_stone, solver_limits);
+            if (winner.has_value()) {
+                PlayoutResults results;
+                results.Add(*winner, count);
+                results.exact = true;
+                on_playout(*winner, count);
+                return results;
+            }
         }
+        return SimulateBatch(board, next_move_stone, count, policy, move_deltas, gen, on_playout);
+    }
+
+    int CountEmpties(const BoardState &board_state)
+    {
+        int count = 0;
+        for (const auto &row : board_state) {
+            count += static_cast<int>(std::count(row.begin(), row.end(), Stone::EMPTY));
+        }
+        return count;
     }
-    return valid_moves;
 }
 
-/**
- * Return winner.
- */
-Stone GetGameWinner(const GameState &board_state) {
-    int black_count = 0;
-    int white_count = 0;
-    for (const auto &row : board_state) {
-        for (const auto &stone : row) {
-            if (stone == Stone::BLACK) {
-                black_count++;
-            } else if (stone == Stone::WHITE) {
-                white_count++;
+template <class Board>
+std::vector<MoveStat> SearchTree<Board>::Search(const BoardState &board_state, Stone next_move_stone,
+    SearchBudget budget, tqdm *pbar)
+{
+    Board board = Board::FromBoardState(board_state);
+    leaf_solver_limits_ = budget.ToSolverLimits(leaf_solver_max_nodes);
+    int board_size = board.Size();
+    move_deltas_.reserve(board_size * board_size);
+    path_.reserve(board_size * board_size);
+    bool warm = nodes_.Size() > 0 && root_board_.has_value() && nodes_[root].NextMoveStone() == next_move_stone
+        && root_board_->black == board.black && root_board_->white == board.white;
+    if (warm && pbar != nullptr) {
+        std::cout << "reuse " << nodes_.Size() << " nodes, root visit count " << nodes_.VisitCount(root) << std::endl;
+    } else if (!warm) {
+        nodes_.Reset();
+        nodes_.SetAmafEnabled(rave_equivalence_ > 0);
+        spare_nodes_.SetAmafEnabled(rave_equivalence_ > 0);
+        nodes_.Allocate(1);
+        nodes_[root].Set(TreeNode::no_move, next_move_stone);
+        root_board_ = board;
+    }
+    for (int i = 0; !budget.Exhausted(i); i += rollouts_per_leaf_) {
+        if (pbar != nullptr) {
+            pbar->progress(i, budget.SimulationCount());
+        }
+        if (nodes_.GetProven(root) != Proven::NONE) {
+            break;
+        }
+        if (Selection(board)) {
+            uint32_t node_index = path_.back();
+            uint32_t leaf_index = ExpandNode(node_index, board);
+            const Node &node = nodes_[node_index];
+            const Node &leaf = nodes_[leaf_index];
+            path_.push_back(leaf_index);
+            move_deltas_.push_back(board.MakeMove(leaf.FromMove(), node.NextMoveStone()));
+            Stone leaf_stone = leaf.NextMoveStone();
+            if (rave_equivalence_ > 0) {
+                auto update_amaf = [&](Stone winner, uint32_t count) { UpdateAmaf(winner, count); };
+                BackPropagate(EvaluateLeaf(board, leaf_stone, rollouts_per_leaf_, endgame_leaf_empties_, solver_,
+                    leaf_solver_limits_, playout_policy_, move_deltas_, gen_, update_amaf));
+            } else {
+                BackPropagate(EvaluateLeaf(board, leaf_stone, rollouts_per_leaf_, endgame_leaf_empties_, solver_,
+                    leaf_solver_limits_, playout_policy_, move_deltas_, gen_));
             }
         }
+        UnmakeMoves(board, move_deltas_);
     }
-    if (black_count == white_count) {
-        return Stone::EMPTY;
-    } else if (black_count > white_count) {
-        return Stone::BLACK;
-    } else {
-        return Stone::WHITE;
+    std::vector<MoveStat> stats;
+    const Node &root_node = nodes_[root];
+    for (uint32_t child = root_node.first_child; child < root_node.first_child + root_node.num_children; ++child) {
+        stats.push_back({nodes_[child].FromMove(), nodes_.VisitCount(child), nodes_.WinCount(child),
+            nodes_.GetProven(child)});
     }
+    return stats;
 }
 
-std::pair<int, int> MonteCarloTreeSearch::SearchMove(const GameState &board_state,
-    Stone next_move_stone, int simulation_count, std::vector<std::tuple<int, int, double>> *move_win_ratio)
+/**
+ * Walk from the root to a node with untried moves, making the moves on board and recording the
+ * nodes in path_. An unvisited child would win the UCB comparison, so stopping at the first node
+ * that is not fully expanded selects the same path as expanding every child up front.
+ * Return false if the node is end of game, its result is already propagated then.
+ */
+template <class Board>
+bool SearchTree<Board>::Selection(Board &board)
 {
-    tqdm pbar;
-    pbar.set_label("search move");
+    path_.clear();
+    path_.push_back(root);
+    uint32_t node_index = root;
+    while (nodes_[node_index].IsFullyExpanded()) {
+        const Node &node = nodes_[node_index];
+        double exploration = UcbExploration(nodes_.VisitCount(node_index));
+        uint32_t best_child = node.first_child + (rave_equivalence_ > 0
+            ? RaveArgmax(nodes_, node.first_child, node.num_children, exploration, rave_equivalence_)
+            : UcbArgmax(nodes_.VisitCounts() + node.first_child, nodes_.HalfWins() + node.first_child,
+                nodes_.ProvenValues() + node.first_child, node.num_children, exploration));
+        move_deltas_.push_back(board.MakeMove(nodes_[best_child].FromMove(), node.NextMoveStone()));
+        node_index = best_child;
+        path_.push_back(node_index);
+    }
+    if (board.IsGameOver()) {
+        Stone winner = board.GetWinner();
+        PlayoutResults results;
+        results.Add(winner, rollouts_per_leaf_);
+        results.exact = true;
+        if (rave_equivalence_ > 0) {
+            UpdateAmaf(winner, rollouts_per_leaf_);
+        }
+        BackPropagate(results);
+        return false;
+    }
+    return true;
+}
 
-    auto time1 = std::chrono::steady_clock::now();
-    root = std::make_shared<TreeNode>(board_state, nullptr, next_move_stone, std::pair<int, int>(-1, -1));
-    for (int i = 0; i < simulation_count; ++i) {
-        pbar.progress(i, simulation_count);
-        auto node = Selection();
-        if (node == nullptr) continue;
-        ExpandNode(node);
-        auto leaf = *(node->children.begin());
-        auto winner = Simulate(leaf->state, leaf->next_move_stone);
-        BackPropagate(leaf, winner);
-    }
-    pbar.finish();
-    auto time2 = std::chrono::steady_clock::now();
-    std::cout << "\nAI think time: " << std::chrono::duration<double>(time2 - time1).count() << "s" << std::endl;
-    if (move_win_ratio != nullptr) {
-        move_win_ratio->clear();
-        for (const auto &ch : root->children) {
-            move_win_ratio->emplace_back(ch->from_move.first, ch->from_move.second, ch->win_count / ch->visit_count);
+/**
+ * Materialize the lowest untried move of the node and return the new child. With RAVE every move
+ * gets its child at once, so the AMAF values rank the moves not tried yet, and the first child is
+ * returned.
+ */
+template <class Board>
+uint32_t SearchTree<Board>::ExpandNode(uint32_t node_index, const Board &board)
+{
+    Stone move_stone = nodes_[node_index].NextMoveStone();
+    auto valid_moves = board.GetValidMoves(move_stone);
+    if (IsEmpty(valid_moves)) {
+        move_stone = OpponentStone(move_stone);
+        valid_moves = board.GetValidMoves(move_stone);
+        nodes_[node_index].SetNextMoveStone(move_stone);
+    }
+    if (rave_equivalence_ > 0) {
+        auto num_children = static_cast<uint16_t>(CountBits(valid_moves));
+        uint32_t first_child = nodes_.Allocate(num_children);
+        for (uint32_t child = first_child; !IsEmpty(valid_moves); ++child) {
+            nodes_[child].Set(PopLowestBit(valid_moves), OpponentStone(move_stone));
         }
+        Node &node = nodes_[node_index];
+        node.first_child = first_child;
+        node.num_children = num_children;
+        node.MarkFullyExpanded();
+        return first_child;
     }
-    return GetBestMove();
+    const Node &node = nodes_[node_index];
+    auto untried_moves = valid_moves;
+    if (node.num_children > 0) {
+        untried_moves = ClearBitsThrough(valid_moves, nodes_[node.first_child + node.num_children - 1].FromMove());
+    }
+    int move = PopLowestBit(untried_moves);
+    uint32_t child = AddChild(node_index, move, OpponentStone(move_stone));
+    if (IsEmpty(untried_moves)) {
+        nodes_[node_index].MarkFullyExpanded();
+    }
+    return child;
 }
 
 /**
- * Return the node selected. If the node is end of game, return nullptr.
+ * Append a child to the node's block. A block holding k children has room for the next power
+ * of two, a full block grows in place when it ends the pool and moves to the end otherwise,
+ * the old copy stays unused until the pool is compacted or reset.
  */
-std::shared_ptr<TreeNode> MonteCarloTreeSearch::Selection()
+template <class Board>
+uint32_t SearchTree<Board>::AddChild(uint32_t node_index, int move, Stone next_move_stone)
+{
+    uint32_t num_children = nodes_[node_index].num_children;
+    uint32_t first_child = nodes_[node_index].first_child;
+    if (num_children == 0) {
+        first_child = nodes_.Allocate(1);
+    } else if ((num_children & (num_children - 1)) == 0) {
+        if (first_child + num_children == nodes_.Size()) {
+            nodes_.Allocate(num_children);
+        } else {
+            uint32_t moved_first_child = nodes_.Allocate(2 * num_children);
+            for (uint32_t i = 0; i < num_children; ++i) {
+                nodes_.CopyNode(moved_first_child + i, nodes_, first_child + i);
+            }
+            first_child = moved_first_child;
+        }
+    }
+    Node &node = nodes_[node_index];
+    node.first_child = first_child;
+    node.num_children = static_cast<uint16_t>(num_children + 1);
+    nodes_.ClearNode(first_child + num_children);
+    nodes_[first_child + num_children].Set(move, next_move_stone);
+    return first_child + num_children;
+}
+
+template <class Board>
+void SearchTree<Board>::BackPropagate(const PlayoutResults &results)
 {
-    auto node = root;
-    while (!node->children.empty()) {
-        node = *std::max_element(node->children.begin(), node->children.end(),
-            [](const std::shared_ptr<TreeNode> &lhs, const std::shared_ptr<TreeNode> &rhs) {
-                return lhs->GetExploitPriority() < rhs->GetExploitPriority();
-            });
+    for (size_t i = path_.size() - 1; i > 0; --i) {
+        nodes_.AddResults(path_[i], results.count, results.HalfWins(nodes_[path_[i - 1]].NextMoveStone()));
     }
-    auto empty_pos = GetEmptyPos(node->state);
-    std::set<std::pair<int, int>> empty_pos_set(empty_pos.begin(), empty_pos.end());
-    if (empty_pos.empty() || (GetValidMovesFromHint(node->next_move_stone, node->state, empty_pos_set).empty() &&
-        GetValidMovesFromHint(ReversiGame::GetOpponentStone(node->next_move_stone), node->state, empty_pos_set).empty()) ) {
-        Stone winner = GetGameWinner(node->state);
-        BackPropagate(node, winner);
-        return nullptr;
+    nodes_.AddResults(root, results.count, 0);
+    if (results.exact) {
+        // the root has no mover, its value is kept for the opponent of its side to move
+        Stone mover = path_.size() > 1 ? nodes_[path_[path_.size() - 2]].NextMoveStone()
+                                       : OpponentStone(nodes_[root].NextMoveStone());
+        uint32_t half_wins = results.HalfWins(mover);
+        PropagateProven(half_wins == 2 * results.count ? Proven::WIN
+            : (half_wins == results.count ? Proven::DRAW : Proven::LOSS));
     }
-    return node;
 }
 
-void MonteCarloTreeSearch::ExpandNode(const std::shared_ptr<TreeNode> &node)
+/**
+ * Add count playouts won by winner to the AMAF counts of the children of every node in path_,
+ * move_deltas_ holding the moves of the path and of the playout. A child counts when the side to
+ * move at its parent plays the child's square at any later ply. Every square is played at most
+ * once in a game, so one mask of the squares played from the node on per side tells them all.
+ */
+template <class Board>
+void SearchTree<Board>::UpdateAmaf(Stone winner, uint32_t count)
 {
-    auto empty_pos = GetEmptyPos(node->state);
-    std::set<std::pair<int, int>> empty_pos_set(empty_pos.begin(), empty_pos.end());
-    auto valid_moves = GetValidMovesFromHint(node->next_move_stone, node->state, empty_pos_set);
-    if (valid_moves.empty()) {
-        node->next_move_stone = ReversiGame::GetOpponentStone(node->next_move_stone);
-        valid_moves = GetValidMovesFromHint(node->next_move_stone, node->state, empty_pos_set);
+    typename Board::Mask played[2]; // black, white
+    auto add_move = [&](const typename Board::MoveDelta &delta) {
+        played[delta.stone == Stone::WHITE ? 1 : 0].Set(delta.square);
+    };
+    size_t tree_depth = path_.size() - 1;
+    for (size_t k = tree_depth; k < move_deltas_.size(); ++k) {
+        add_move(move_deltas_[k]);
     }
-    for (const auto &move : valid_moves) {
-        GameState new_state = node->state;
-        ReversiGame::UpdateBoardWithPlacementStone(new_state, move.first, move.second, node->next_move_stone);
-        auto new_node = std::make_shared<TreeNode>(new_state, node, ReversiGame::GetOpponentStone(node->next_move_stone), move);
-        node->children.emplace_back(new_node);
+    for (size_t i = tree_depth; i-- > 0;) {
+        add_move(move_deltas_[i]);
+        const Node &node = nodes_[path_[i]];
+        Stone mover = node.NextMoveStone();
+        const auto &mover_played = played[mover == Stone::WHITE ? 1 : 0];
+        uint32_t half_wins = winner == mover ? 2 * count : (winner == Stone::EMPTY ? count : 0);
+        for (uint32_t child = node.first_child; child < node.first_child + node.num_children; ++child) {
+            if (TestBit(mover_played, nodes_[child].FromMove())) {
+                nodes_.AddAmafResults(child, count, half_wins);
+            }
+        }
     }
 }
 
-void MonteCarloTreeSearch::BackPropagate(const std::shared_ptr<TreeNode> &node, Stone win_stone)
+/**
+ * Mark the leaf at the end of path_ proven and prove its ancestors while their value follows.
+ */
+template <class Board>
+void SearchTree<Board>::PropagateProven(Proven leaf_proven)
 {
-    auto cur_node = node;
-    while (cur_node != root) {
-        cur_node->visit_count++;
-        if (cur_node->parent->next_move_stone == win_stone) {
-            cur_node->win_count++;
-        } else if (win_stone == Stone::EMPTY){
-            cur_node->win_count += 0.5;
+    nodes_.SetProven(path_.back(), leaf_proven);
+    for (size_t i = path_.size() - 1; i > 0; --i) {
+        Proven proven = ProveNode(path_[i - 1]);
+        if (proven == Proven::NONE) {
+            return;
         }
-        cur_node = cur_node->parent;
+        // the children's values are for the node's side to move, the node's for the side that moved into it
+        Stone mover = i > 1 ? nodes_[path_[i - 2]].NextMoveStone() : OpponentStone(nodes_[root].NextMoveStone());
+        nodes_.SetProven(path_[i - 1], mover == nodes_[path_[i - 1]].NextMoveStone() ? proven : OpponentProven(proven));
     }
-    root->visit_count++;
 }
 
 /**
- * Return winner.
+ * Value of the node for its side to move as far as its children prove it: a winning move proves a
+ * win, else the best move once every legal move has a proven child.
  */
-Stone MonteCarloTreeSearch::Simulate(const GameState &board_state, Stone next_move_stone)
+template <class Board>
+Proven SearchTree<Board>::ProveNode(uint32_t node_index) const
 {
-    std::vector<std::pair<int, int>> direction = {
-        {-1, -1}, {-1, 0}, {-1, 1},
-        {0, -1},          {0, 1},
-        {1, -1},  {1, 0},  {1, 1}
-    };
-    GameState board_state_copy = board_state;
-    auto empty_pos = GetEmptyPos(board_state);
-    std::set<std::pair<int, int>> empty_pos_set(empty_pos.begin(), empty_pos.end());
-    auto cur_move_stone = next_move_stone;
-    while(true) {
-        auto valid_moves = GetValidMovesFromHint(cur_move_stone, board_state_copy, empty_pos_set);
-        if (valid_moves.empty()) {
-            cur_move_stone = ReversiGame::GetOpponentStone(cur_move_stone);
-            valid_moves = GetValidMovesFromHint(cur_move_stone, board_state_copy, empty_pos_set);
-            if (valid_moves.empty()) {
-                return GetGameWinner(board_state_copy);
-            }
+    const Node &node = nodes_[node_index];
+    Proven best = Proven::LOSS;
+    for (uint32_t child = node.first_child; child < node.first_child + node.num_children; ++child) {
+        Proven proven = nodes_.GetProven(child);
+        if (proven == Proven::WIN) {
+            return Proven::WIN;
         }
-        auto move = valid_moves[gen() % valid_moves.size()];
-        ReversiGame::UpdateBoardWithPlacementStone(board_state_copy, move.first, move.second, cur_move_stone);
-        empty_pos_set.erase(move);
-        cur_move_stone = ReversiGame::GetOpponentStone(cur_move_stone);
-        for (const auto &dir: direction) {
-            int nx = move.first + dir.first;
-            int ny = move.second + dir.second;
-            if (nx >= 0 && nx < board_state.size() && ny >= 0 && ny < board_state.size()) {
-                if (board_state_copy[nx][ny] == Stone::EMPTY) {
-                    empty_pos_set.emplace(nx, ny);
-                }
-            }
+        if (proven == Proven::NONE) {
+            best = Proven::NONE;
+        } else if (best != Proven::NONE && proven > best) {
+            best = proven;
         }
     }
+    return node.IsFullyExpanded() ? best : Proven::NONE;
 }
 
-std::pair<int, int> MonteCarloTreeSearch::GetBestMove()
+template <class Board>
+void SearchTree<Board>::AdvanceRoot(int square)
 {
-    std::shared_ptr<TreeNode> best_node = *std::max_element(root->children.begin(), root->children.end(),
-        [](const std::shared_ptr<TreeNode> &lhs, const std::shared_ptr<TreeNode> &rhs) {
-            return lhs->visit_count < rhs->visit_count;
-        });
-    std::cout << "win ratio: " << best_node->win_count << "/" << best_node->visit_count
-        << " = " << best_node->win_count / best_node->visit_count << std::endl;
-    for (const auto &ch : root->children) {
-        std::cout << "[" << static_cast<char>(ch->from_move.first + 'A') << ch->from_move.second << ":" << ch->win_count << "/" << ch->visit_count
-            << "=" << ch->win_count / ch->visit_count << "] ";
+    if (nodes_.Size() == 0 || !root_board_.has_value()) {
+        return;
     }
-    std::cout << "\nroot visit count: " << root->visit_count << std::endl;
-    return best_node->from_move;
+    const Node &root_node = nodes_[root];
+    for (uint32_t child = root_node.first_child; child < root_node.first_child + root_node.num_children; ++child) {
+        if (nodes_[child].FromMove() == square && nodes_[child].num_children > 0) {
+            root_board_->MakeMove(square, root_node.NextMoveStone());
+            CompactSubtree(child);
+            return;
+        }
+    }
+    nodes_.Reset();
+    root_board_.reset();
 }
 
-std::vector<int> MonteCarloTreeSearch::StatDepthNodesNumbers() const {
+/**
+ * Copy the subtree under new_root breadth first into spare_nodes_ and swap the pools. The cost
+ * is linear in the kept nodes, the dropped ones go away with the Reset of the old pool.
+ */
+template <class Board>
+void SearchTree<Board>::CompactSubtree(uint32_t new_root)
+{
+    spare_nodes_.Reset();
+    spare_nodes_.Allocate(1);
+    spare_nodes_.CopyNode(root, nodes_, new_root);
+    spare_nodes_[root].SetFromMove(TreeNode::no_move);
+    // spare_nodes_ doubles as the queue, node i gets its children copied when the loop reaches it
+    for (uint32_t i = 0; i < spare_nodes_.Size(); ++i) {
+        uint32_t old_first_child = spare_nodes_[i].first_child;
+        uint32_t num_children = spare_nodes_[i].num_children;
+        if (num_children == 0) {
+            continue;
+        }
+        // keep the power of two room AddChild expects unless the block is complete
+        uint32_t capacity = num_children;
+        if (!spare_nodes_[i].IsFullyExpanded()) {
+            for (capacity = 1; capacity < num_children; capacity *= 2) {
+            }
+        }
+        uint32_t first_child = spare_nodes_.Allocate(capacity);
+        for (uint32_t k = 0; k < num_children; ++k) {
+            spare_nodes_.CopyNode(first_child + k, nodes_, old_first_child + k);
+        }
+        spare_nodes_[i].first_child = first_child;
+    }
+    std::swap(nodes_, spare_nodes_);
+    spare_nodes_.Reset();
+}
+
+template <class Board>
+std::vector<int> SearchTree<Board>::StatDepthNodesNumbers() const {
     std::vector<int> depth_nodes_numbers;
-    std::function<void(const TreeNode &, int)> dfs =
-        [&](const TreeNode &node, int depth) {
+    if (nodes_.Size() == 0) {
+        return depth_nodes_numbers;
+    }
+    std::function<void(uint32_t, int)> dfs =
+        [&](uint32_t node_index, int depth) {
             if (depth >= depth_nodes_numbers.size()) {
                 depth_nodes_numbers.push_back(0);
             }
             depth_nodes_numbers[depth] += 1;
-            for (const auto &ch : node.children) {
-                dfs(*ch, depth + 1);
+            const Node &node = nodes_[node_index];
+            for (uint32_t child = node.first_child; child < node.first_child + node.num_children; ++child) {
+                dfs(child, depth + 1);
             }
         };
-    dfs(*root, 0);
+    dfs(root, 0);
+    return depth_nodes_numbers;
+}
+
+template <class Board>
+int SearchTree<Board>::GetTreeNodesNumbers_(uint32_t node_index) const {
+    int count = 1;
+    const Node &node = nodes_[node_index];
+    for (uint32_t child = node.first_child; child < node.first_child + node.num_children; ++child) {
+        count += GetTreeNodesNumbers_(child);
+    }
+    return count;
+}
+
+template <class Board>
+int SearchTree<Board>::GetTreeDepth_(uint32_t node_index) const {
+    int depth = 0;
+    const Node &node = nodes_[node_index];
+    for (uint32_t child = node.first_child; child < node.first_child + node.num_children; ++child) {
+        depth = std::max(depth, GetTreeDepth_(child));
+    }
+    return depth + 1;
+}
+
+template class SearchTree<Board<6>>;
+template class SearchTree<Board<8>>;
+template class SearchTree<Board<10>>;
+template class SearchTree<Board<12>>;
+template class SearchTree<Board<16>>;
+template class SearchTree<MultiBitBoard>;
+
+template <class Board>
+std::vector<MoveStat> GraphSearch<Board>::Search(const BoardState &board_state, Stone next_move_stone,
+    SearchBudget budget, tqdm *pbar)
+{
+    Board board = Board::FromBoardState(board_state);
+    leaf_solver_limits_ = budget.ToSolverLimits(leaf_solver_max_nodes);
+    int board_size = board.Size();
+    move_deltas_.reserve(board_size * board_size);
+    path_.reserve(board_size * board_size);
+    if (table_.Capacity() == 0) {
+        table_.Resize(table_size_);
+    }
+    root_discs_ = CountDiscs(board);
+    if (IsEmpty(board.GetValidMoves(next_move_stone))) {
+        next_move_stone = OpponentStone(next_move_stone);
+    }
+    // the first simulation from a new root only evaluates the root, the second reaches a move
+    for (int i = 0, runs = 0; runs < 2 || !budget.Exhausted(i); i += rollouts_per_leaf_, ++runs) {
+        if (pbar != nullptr) {
+            pbar->progress(i, budget.SimulationCount());
+        }
+        RunSimulation(board, next_move_stone);
+        UnmakeMoves(board, move_deltas_);
+    }
+    std::vector<MoveStat> stats;
+    ForEachBit(board.GetValidMoves(next_move_stone), [&](int move) {
+        uint32_t child = table_.Find(board.HashAfterMove(move, next_move_stone));
+        if (child != TranspositionTable::npos) {
+            stats.push_back({move, table_[child].visit_count, table_[child].WinCount()});
+        }
+    });
+    return stats;
+}
+
+/**
+ * Descend from the root while the positions are in the table, add the first position that is
+ * not, play it out and back up the result. The moves stay in move_deltas_ for UnmakeMoves.
+ */
+template <class Board>
+void GraphSearch<Board>::RunSimulation(Board &board, Stone next_move_stone)
+{
+    path_.clear();
+    Stone stone = next_move_stone;
+    uint32_t slot = FindOrInsert(board, stone);
+    path_.push_back({slot, board.Hash(stone), OpponentStone(stone)});
+    while (table_[slot].visit_count > 0) {
+        if (IsEmpty(board.GetValidMoves(stone))) {
+            if (IsEmpty(board.GetValidMoves(OpponentStone(stone)))) {
+                PlayoutResults results;
+                results.Add(board.GetWinner(), rollouts_per_leaf_);
+                BackPropagate(results);
+                return;
+            }
+            // a pass leads to the same discs with the other side to move
+        } else {
+            int move = SelectMove(board, stone, table_[slot].visit_count);
+            move_deltas_.push_back(board.MakeMove(move, stone));
+        }
+        stone = OpponentStone(stone);
+        slot = FindOrInsert(board, stone);
+        path_.push_back({slot, board.Hash(stone), OpponentStone(stone)});
+    }
+    BackPropagate(EvaluateLeaf(board, stone, rollouts_per_leaf_, endgame_leaf_empties_, solver_, leaf_solver_limits_,
+        playout_policy_, move_deltas_, gen_));
+}
+
+/**
+ * The legal move with the best UCB priority of the position it leads to, the first move whose
+ * position is not in the table is taken at once.
+ */
+template <class Board>
+int GraphSearch<Board>::SelectMove(const Board &board, Stone next_move_stone, uint32_t parent_visit_count)
+{
+    auto valid_moves = board.GetValidMoves(next_move_stone);
+    int best_move = -1;
+    double best_priority = -std::numeric_limits<double>::infinity();
+    double exploration = UcbExploration(parent_visit_count);
+    while (!IsEmpty(valid_moves)) {
+        int move = PopLowestBit(valid_moves);
+        uint32_t child = table_.Find(board.HashAfterMove(move, next_move_stone));
+        if (child == TranspositionTable::npos) {
+            return move;
+        }
+        double priority = UcbPriority(table_[child].WinCount(), table_[child].visit_count, exploration);
+        if (priority > best_priority) {
+            best_priority = priority;
+            best_move = move;
+        }
+    }
+    return best_move;
+}
+
+template <class Board>
+uint32_t GraphSearch<Board>::FindOrInsert(const Board &board, Stone next_move_stone)
+{
+    uint64_t key = board.Hash(next_move_stone);
+    uint32_t slot = table_.Find(key);
+    if (slot == TranspositionTable::npos) {
+        slot = table_.Insert(key, CountDiscs(board), root_discs_);
+    }
+    return slot;
+}
+
+/**
+ * Add the result to every position of path_, an entry replaced since it was visited has
+ * another key and is left alone.
+ */
+template <class Board>
+void GraphSearch<Board>::BackPropagate(const PlayoutResults &results)
+{
+    for (const PathEntry &step : path_) {
+        TranspositionTable::Entry &entry = table_[step.slot];
+        if (entry.key != step.key) {
+            continue;
+        }
+        entry.visit_count += results.count;
+        entry.half_wins += results.HalfWins(step.mover);
+    }
+}
+
+template <class Board>
+int GraphSearch<Board>::GetTreeNodesNumbers() const
+{
+    int count = 0;
+    for (uint32_t slot = 0; slot < table_.Capacity(); ++slot) {
+        if (table_[slot].key != 0 && table_[slot].num_discs >= root_discs_) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+template <class Board>
+int GraphSearch<Board>::GetTreeDepth() const
+{
+    return static_cast<int>(StatDepthNodesNumbers().size());
+}
+
+template <class Board>
+std::vector<int> GraphSearch<Board>::StatDepthNodesNumbers() const
+{
+    std::vector<int> depth_nodes_numbers;
+    for (uint32_t slot = 0; slot < table_.Capacity(); ++slot) {
+        const auto &entry = table_[slot];
+        if (entry.key == 0 || entry.num_discs < root_discs_) {
+            continue;
+        }
+        size_t depth = entry.num_discs - root_discs_;
+        if (depth >= depth_nodes_numbers.size()) {
+            depth_nodes_numbers.resize(depth + 1, 0);
+        }
+        depth_nodes_numbers[depth] += 1;
+    }
+    return depth_nodes_numbers;
+}
+
+template class GraphSearch<Board<6>>;
+template class GraphSearch<Board<8>>;
+template class GraphSearch<Board<10>>;
+template class GraphSearch<Board<12>>;
+template class GraphSearch<Board<16>>;
+template class GraphSearch<MultiBitBoard>;
+
+uint32_t SharedNodePool::Allocate(uint32_t count)
+{
+    uint32_t size = size_.load(std::memory_order_relaxed);
+    uint32_t first;
+    do {
+        first = size;
+        if ((first & (chunk_size - 1)) + count > chunk_size) {
+            first = (first | (chunk_size - 1)) + 1; // a block does not cross into the next chunk
+        }
+        if (first + count > max_chunks * chunk_size) {
+            return npos;
+        }
+    } while (!size_.compare_exchange_weak(size, first + count, std::memory_order_relaxed));
+    auto &chunk = chunks_[first >> chunk_bits];
+    if (chunk.load(std::memory_order_acquire) == nullptr) {
+        std::lock_guard<std::mutex> lock(chunk_mutex_);
+        if (chunk.load(std::memory_order_relaxed) == nullptr) {
+            chunk.store(new SharedTreeNode[chunk_size], std::memory_order_release);
+        }
+    }
+    return first;
+}
+
+template <class Board>
+SharedSearchTree<Board>::SharedSearchTree(int num_threads, unsigned seed)
+    : workers_(num_threads)
+{
+    for (int i = 0; i < num_threads; ++i) {
+        std::seed_seq seed_sequence{seed, static_cast<unsigned>(i)};
+        workers_[i].gen.seed(seed_sequence);
+    }
+}
+
+template <class Board>
+std::vector<MoveStat> SharedSearchTree<Board>::Search(const BoardState &board_state, Stone next_move_stone,
+    SearchBudget budget, tqdm *pbar)
+{
+    Board board = Board::FromBoardState(board_state);
+    leaf_solver_limits_ = budget.ToSolverLimits(leaf_solver_max_nodes);
+    bool warm = has_tree_ && root_board_.has_value()
+        && SharedTreeNode::NextMoveStone(pool_[root_].links.load()) == next_move_stone
+        && root_board_->black == board.black && root_board_->white == board.white;
+    if (warm && pbar != nullptr) {
+        std::cout << "reuse " << GetTreeNodesNumbers() << " nodes, root visit count "
+                  << SharedTreeNode::VisitCount(pool_[root_].stats.load()) << std::endl;
+    } else if (!warm) {
+        pool_.Reset();
+        root_ = pool_.Allocate(1);
+        pool_[root_].stats.store(0);
+        pool_[root_].links.store(SharedTreeNode::MakeLinks(SharedTreeNode::no_move, next_move_stone));
+        root_board_ = board;
+    }
+    has_tree_ = true;
+    next_simulation_.store(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        threads.emplace_back(&SharedSearchTree::RunWorker, this, std::ref(workers_[i]), board, budget, nullptr);
+    }
+    RunWorker(workers_[0], board, budget, pbar);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<MoveStat> stats;
+    uint64_t links = pool_[root_].links.load();
+    uint32_t first_child = SharedTreeNode::FirstChild(links);
+    for (uint32_t child = first_child; child < first_child + SharedTreeNode::NumChildren(links); ++child) {
+        uint64_t child_stats = pool_[child].stats.load();
+        stats.push_back({SharedTreeNode::FromMove(pool_[child].links.load()), SharedTreeNode::VisitCount(child_stats),
+            SharedTreeNode::HalfWins(child_stats) * 0.5});
+    }
+    return stats;
+}
+
+template <class Board>
+void SharedSearchTree<Board>::AdvanceRoot(int square)
+{
+    if (!has_tree_ || !root_board_.has_value()) {
+        return;
+    }
+    uint64_t links = pool_[root_].links.load();
+    uint32_t first_child = SharedTreeNode::FirstChild(links);
+    for (uint32_t child = first_child; child < first_child + SharedTreeNode::NumChildren(links); ++child) {
+        uint64_t child_links = pool_[child].links.load();
+        if (SharedTreeNode::FromMove(child_links) == square && SharedTreeNode::NumChildren(child_links) > 0) {
+            root_board_->MakeMove(square, SharedTreeNode::NextMoveStone(links));
+            CompactSubtree(child);
+            return;
+        }
+    }
+    has_tree_ = false;
+    root_board_.reset();
+}
+
+/**
+ * Copy the subtree under new_root breadth first into spare_pool_ and swap the pools. Allocate
+ * may skip the end of a chunk, so the copied nodes are walked from compact_queue_ rather than
+ * by index.
+ */
+template <class Board>
+void SharedSearchTree<Board>::CompactSubtree(uint32_t new_root)
+{
+    spare_pool_.Reset();
+    compact_queue_.clear();
+    uint32_t root = spare_pool_.Allocate(1);
+    spare_pool_[root].stats.store(pool_[new_root].stats.load());
+    spare_pool_[root].links.store(pool_[new_root].links.load()
+        | (SharedTreeNode::move_mask << SharedTreeNode::move_shift));
+    compact_queue_.push_back(root);
+    for (size_t i = 0; i < compact_queue_.size(); ++i) {
+        SharedTreeNode &node = spare_pool_[compact_queue_[i]];
+        uint64_t links = node.links.load();
+        int num_children = SharedTreeNode::NumChildren(links);
+        if (num_children == 0) {
+            continue;
+        }
+        uint32_t old_first_child = SharedTreeNode::FirstChild(links);
+        uint32_t first_child = spare_pool_.Allocate(num_children);
+        if (first_child == SharedNodePool::npos) {
+            has_tree_ = false;
+            root_board_.reset();
+            return;
+        }
+        for (int k = 0; k < num_children; ++k) {
+            spare_pool_[first_child + k].stats.store(pool_[old_first_child + k].stats.load());
+            spare_pool_[first_child + k].links.store(pool_[old_first_child + k].links.load());
+            compact_queue_.push_back(first_child + k);
+        }
+        node.links.store((links & ~uint64_t{0xFFFFFFFF}) | first_child);
+    }
+    pool_.Swap(spare_pool_);
+    root_ = root;
+}
+
+template <class Board>
+void SharedSearchTree<Board>::RunWorker(Worker &worker, Board board, SearchBudget budget, tqdm *pbar)
+{
+    int board_size = board.Size();
+    worker.path.reserve(board_size * board_size);
+    worker.move_deltas.reserve(board_size * board_size);
+    while (true) {
+        // every worker checks the shared count against its own copy of the budget
+        int i = next_simulation_.fetch_add(rollouts_per_leaf_, std::memory_order_relaxed);
+        if (budget.Exhausted(i)) {
+            break;
+        }
+        if (pbar != nullptr) {
+            pbar->progress(i, budget.SimulationCount());
+        }
+        RunSimulation(worker, board);
+        UnmakeMoves(board, worker.move_deltas);
+    }
+}
+
+/**
+ * Select down to a leaf adding the visits of the playout batch to every node on the way, expand
+ * the leaf and play out from one of its new children. The children of a node never change once published, so the
+ * walk reads them without locks.
+ */
+template <class Board>
+void SharedSearchTree<Board>::RunSimulation(Worker &worker, Board &board)
+{
+    worker.path.clear();
+    uint32_t node_index = root_;
+    uint64_t virtual_visits = SharedTreeNode::one_visit * rollouts_per_leaf_;
+    pool_[node_index].stats.fetch_add(virtual_visits, std::memory_order_relaxed);
+    worker.path.push_back({node_index, Stone::EMPTY});
+    while (true) {
+        uint64_t links = pool_[node_index].links.load(std::memory_order_acquire);
+        bool leaf = SharedTreeNode::NumChildren(links) == 0;
+        if (leaf) {
+            if (board.IsGameOver()) {
+                PlayoutResults results;
+                results.Add(board.GetWinner(), rollouts_per_leaf_);
+                BackPropagate(worker, results);
+                return;
+            }
+            if (!TryExpand(node_index, board)) {
+                break;
+            }
+            links = pool_[node_index].links.load(std::memory_order_acquire);
+        }
+        uint32_t child = SelectChild(node_index, links);
+        pool_[child].stats.fetch_add(virtual_visits, std::memory_order_relaxed);
+        Stone move_stone = SharedTreeNode::NextMoveStone(links);
+        int move = SharedTreeNode::FromMove(pool_[child].links.load(std::memory_order_relaxed));
+        worker.move_deltas.push_back(board.MakeMove(move, move_stone));
+        worker.path.push_back({child, move_stone});
+        node_index = child;
+        if (leaf) {
+            break;
+        }
+    }
+    Stone next_move_stone = SharedTreeNode::NextMoveStone(pool_[node_index].links.load(std::memory_order_relaxed));
+    BackPropagate(worker, EvaluateLeaf(board, next_move_stone, rollouts_per_leaf_, endgame_leaf_empties_,
+        worker.solver, leaf_solver_limits_, playout_policy_, worker.move_deltas, worker.gen));
+}
+
+/**
+ * Create every child of the node, return false when another thread is already doing it or the
+ * pool is full.
+ */
+template <class Board>
+bool SharedSearchTree<Board>::TryExpand(uint32_t node_index, const Board &board)
+{
+    SharedTreeNode &node = pool_[node_index];
+    uint64_t links = node.links.load(std::memory_order_acquire);
+    if (SharedTreeNode::NumChildren(links) > 0) {
+        return true;
+    }
+    if ((links & SharedTreeNode::expanding_bit)
+        || !node.links.compare_exchange_strong(links, links | SharedTreeNode::expanding_bit,
+                                               std::memory_order_acquire)) {
+        return SharedTreeNode::NumChildren(node.links.load(std::memory_order_acquire)) > 0;
+    }
+    Stone move_stone = SharedTreeNode::NextMoveStone(links);
+    auto valid_moves = board.GetValidMoves(move_stone);
+    if (IsEmpty(valid_moves)) {
+        move_stone = OpponentStone(move_stone);
+        valid_moves = board.GetValidMoves(move_stone);
+    }
+    int num_children = CountBits(valid_moves);
+    uint32_t first_child = pool_.Allocate(num_children);
+    if (first_child == SharedNodePool::npos) {
+        node.links.store(links, std::memory_order_release);
+        return false;
+    }
+    uint32_t child = first_child;
+    ForEachBit(valid_moves, [&](int move) {
+        pool_[child].stats.store(0, std::memory_order_relaxed);
+        pool_[child].links.store(SharedTreeNode::MakeLinks(move, OpponentStone(move_stone)),
+                                 std::memory_order_relaxed);
+        ++child;
+    });
+    uint64_t published = SharedTreeNode::MakeLinks(SharedTreeNode::FromMove(links), move_stone) | first_child
+        | (static_cast<uint64_t>(num_children) << SharedTreeNode::num_children_shift);
+    node.links.store(published, std::memory_order_release);
+    return true;
+}
+
+template <class Board>
+uint32_t SharedSearchTree<Board>::SelectChild(uint32_t node_index, uint64_t links) const
+{
+    double exploration = UcbExploration(
+        SharedTreeNode::VisitCount(pool_[node_index].stats.load(std::memory_order_relaxed)));
+    uint32_t first_child = SharedTreeNode::FirstChild(links);
+    uint32_t best_child = first_child;
+    double best_priority = -std::numeric_limits<double>::infinity();
+    for (uint32_t child = first_child; child < first_child + SharedTreeNode::NumChildren(links); ++child) {
+        uint64_t stats = pool_[child].stats.load(std::memory_order_relaxed);
+        double priority = UcbPriority(SharedTreeNode::HalfWins(stats) * 0.5, SharedTreeNode::VisitCount(stats),
+            exploration);
+        if (priority > best_priority) {
+            best_priority = priority;
+            best_child = child;
+        }
+    }
+    return best_child;
+}
+
+/**
+ * The visits were counted during selection, only the result is added here.
+ */
+template <class Board>
+void SharedSearchTree<Board>::BackPropagate(const Worker &worker, const PlayoutResults &results)
+{
+    for (size_t i = 1; i < worker.path.size(); ++i) {
+        const PathStep &step = worker.path[i];
+        pool_[step.node].stats.fetch_add(results.HalfWins(step.mover), std::memory_order_relaxed);
+    }
+}
+
+template <class Board>
+std::vector<int> SharedSearchTree<Board>::StatDepthNodesNumbers() const
+{
+    std::vector<int> depth_nodes_numbers;
+    if (has_tree_) {
+        CollectDepthNodesNumbers(root_, 0, depth_nodes_numbers);
+    }
     return depth_nodes_numbers;
 }
 
-int MonteCarloTreeSearch::GetTreeNodesNumbers_(const TreeNode &node) const {
+template <class Board>
+void SharedSearchTree<Board>::CollectDepthNodesNumbers(uint32_t node_index, size_t depth,
+                                                       std::vector<int> &depth_nodes_numbers) const
+{
+    if (depth >= depth_nodes_numbers.size()) {
+        depth_nodes_numbers.push_back(0);
+    }
+    depth_nodes_numbers[depth] += 1;
+    uint64_t links = pool_[node_index].links.load();
+    uint32_t first_child = SharedTreeNode::FirstChild(links);
+    for (uint32_t child = first_child; child < first_child + SharedTreeNode::NumChildren(links); ++child) {
+        CollectDepthNodesNumbers(child, depth + 1, depth_nodes_numbers);
+    }
+}
+
+template <class Board>
+int SharedSearchTree<Board>::GetTreeNodesNumbers_(uint32_t node_index) const
+{
     int count = 1;
-    for (auto &ch : node.children) {
-        count += GetTreeNodesNumbers_(*ch);
+    uint64_t links = pool_[node_index].links.load();
+    uint32_t first_child = SharedTreeNode::FirstChild(links);
+    for (uint32_t child = first_child; child < first_child + SharedTreeNode::NumChildren(links); ++child) {
+        count += GetTreeNodesNumbers_(child);
     }
     return count;
 }
 
-int MonteCarloTreeSearch::GetTreeDepth_(const TreeNode &node) const {
+template <class Board>
+int SharedSearchTree<Board>::GetTreeDepth_(uint32_t node_index) const
+{
     int depth = 0;
-    for (auto &ch : node.children) {
-        depth = std::max(depth, GetTreeDepth_(*ch));
+    uint64_t links = pool_[node_index].links.load();
+    uint32_t first_child = SharedTreeNode::FirstChild(links);
+    for (uint32_t child = first_child; child < first_child + SharedTreeNode::NumChildren(links); ++child) {
+        depth = std::max(depth, GetTreeDepth_(child));
     }
     return depth + 1;
-}
\ No newline at end of file
+}
+
+template class SharedSearchTree<Board<6>>;
+template class SharedSearchTree<Board<8>>;
+template class SharedSearchTree<Board<10>>;
+template class SharedSearchTree<Board<12>>;
+template class SharedSearchTree<Board<16>>;
+template class SharedSearchTree<MultiBitBoard>;
+
+void MonteCarloTreeSearch::SetOptions(const Options &options)
+{
+    StopPondering();
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    if (!trees_.empty()) {
+        trees_.clear();
+        SetBoardSizeLocked(tree_board_size_);
+    }
+}
+
+void MonteCarloTreeSearch::SetBoardSize(int board_size)
+{
+    StopPondering();
+    std::lock_guard<std::mutex> lock(mutex_);
+    SetBoardSizeLocked(board_size);
+}
+
+void MonteCarloTreeSearch::SetBoardSizeLocked(int board_size)
+{
+    if (!trees_.empty() && tree_board_size_ == board_size) {
+        return;
+    }
+    int num_workers = NumWorkers();
+    // a shared tree runs all the workers itself, otherwise every worker has a tree
+    bool shared_tree = options_.shared_tree && !options_.transpositions;
+    int num_trees = shared_tree ? 1 : num_workers;
+    trees_.clear();
+    for (int i = 0; i < num_trees; ++i) {
+        auto seed = static_cast<unsigned>(i);
+        trees_.push_back(DispatchBoardType(board_size, [&](auto tag) -> std::unique_ptr<SearchTreeBase> {
+            using BoardType = typename decltype(tag)::type;
+            if (options_.transpositions) {
+                uint32_t table_size = std::max<uint32_t>(options_.transposition_table_size / num_workers, 2);
+                return std::make_unique<GraphSearch<BoardType>>(table_size, seed);
+            }
+            if (shared_tree) {
+                return std::make_unique<SharedSearchTree<BoardType>>(num_workers, seed);
+            }
+            return std::make_unique<SearchTree<BoardType>>(seed);
+        }));
+        trees_.back()->SetRolloutsPerLeaf(options_.rollouts_per_leaf);
+        trees_.back()->SetEndgameLeafEmpties(options_.endgame_leaf_empties);
+        trees_.back()->SetPlayoutPolicy(options_.playout_policy);
+        trees_.back()->SetRaveEquivalence(options_.rave_equivalence);
+    }
+    tree_board_size_ = board_size;
+}
+
+int MonteCarloTreeSearch::NumWorkers() const
+{
+    if (options_.threads > 0) {
+        return options_.threads;
+    }
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+std::pair<int, int> MonteCarloTreeSearch::SearchMove(const BoardState &board_state, Stone next_move_stone,
+    int simulation_count, std::vector<std::tuple<int, int, double>> *move_win_ratio,
+    std::optional<uint64_t> root_generation)
+{
+    if (!root_generation.has_value()) {
+        root_generation = root_generation_.load();
+    }
+    StopPondering();
+    std::lock_guard<std::mutex> lock(mutex_);
+    tqdm pbar;
+    pbar.set_label("search move");
+    ResetSearchStopLocked(root_generation);
+    return SearchMoveLocked(board_state, next_move_stone, SearchBudget(simulation_count, search_stop_), &pbar,
+        move_win_ratio);
+}
+
+std::pair<int, int> MonteCarloTreeSearch::SearchMove(const BoardState &board_state, Stone next_move_stone,
+    SearchBudget::Clock::time_point deadline, std::vector<std::tuple<int, int, double>> *move_win_ratio,
+    std::optional<uint64_t> root_generation)
+{
+    if (!root_generation.has_value()) {
+        root_generation = root_generation_.load();
+    }
+    StopPondering();
+    std::lock_guard<std::mutex> lock(mutex_);
+    ResetSearchStopLocked(root_generation);
+    return SearchMoveLocked(board_state, next_move_stone, SearchBudget(deadline, search_stop_), nullptr,
+        move_win_ratio);
+}
+
+/**
+ * Exact win, draw or loss of every legal move when the position is within options_.endgame_empties,
+ * each is proven and counts as one visit with a win count of 1, 0.5 or 0. Empty when the solver
+ * does not apply or the stop flag of budget or half the time to its deadline ends it first.
+ */
+std::vector<MoveStat> MonteCarloTreeSearch::SolveEndgameLocked(const BoardState &board_state,
+    Stone next_move_stone, const SearchBudget &budget) const
+{
+    std::vector<MoveStat> stats;
+    if (options_.endgame_empties <= 0 || CountEmpties(board_state) > options_.endgame_empties) {
+        return stats;
+    }
+    DispatchBoardType(static_cast<int>(board_state.size()), [&](auto tag) {
+        using BoardType = typename decltype(tag)::type;
+        BoardType board = BoardType::FromBoardState(board_state);
+        EndgameSolver<BoardType> solver;
+        SolverLimits limits = budget.ToSolverLimits();
+        if (limits.deadline.has_value()) {
+            // keep half of the time for the search in case the solver does not finish
+            auto now = SearchBudget::Clock::now();
+            limits.deadline = now + (*limits.deadline - now) / 2;
+        }
+        auto valid_moves = board.GetValidMoves(next_move_stone);
+        while (!IsEmpty(valid_moves)) {
+            int move = PopLowestBit(valid_moves);
+            auto delta = board.MakeMove(move, next_move_stone);
+            std::optional<int> result = solver.Solve(board, OpponentStone(next_move_stone), -1, 1, limits);
+            board.UnmakeMove(delta);
+            if (!result.has_value()) {
+                stats.clear();
+                return;
+            }
+            int score = -*result;
+            Proven proven = score > 0 ? Proven::WIN : (score == 0 ? Proven::DRAW : Proven::LOSS);
+            stats.push_back({move, 1, score > 0 ? 1.0 : (score == 0 ? 0.5 : 0.0), proven});
+        }
+    });
+    return stats;
+}
+
+/**
+ * Run the workers and merge their root move statistics, sorted by square.
+ */
+std::vector<MoveStat> MonteCarloTreeSearch::RunSearchLocked(const BoardState &board_state, Stone next_move_stone,
+    const SearchBudget &budget, tqdm *pbar)
+{
+    SetBoardSizeLocked(static_cast<int>(board_state.size()));
+    ApplyPendingMovesLocked();
+    int num_workers = static_cast<int>(trees_.size());
+    SearchBudget worker_budget = budget.Split(num_workers);
+    std::vector<std::vector<MoveStat>> worker_stats(num_workers);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < num_workers; ++i) {
+        workers.emplace_back([&, i]() {
+            worker_stats[i] = trees_[i]->Search(board_state, next_move_stone, worker_budget, nullptr);
+        });
+    }
+    worker_stats[0] = trees_[0]->Search(board_state, next_move_stone, worker_budget, pbar);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    if (pbar != nullptr) {
+        pbar->finish();
+    }
+
+    // every worker lists its root moves in increasing square order
+    std::vector<MoveStat> stats;
+    for (const auto &worker_stat : worker_stats) {
+        for (const MoveStat &stat : worker_stat) {
+            auto it = std::find_if(stats.begin(), stats.end(), [&](const MoveStat &s) { return s.move == stat.move; });
+            if (it == stats.end()) {
+                stats.push_back(stat);
+            } else {
+                it->visit_count += stat.visit_count;
+                it->win_count += stat.win_count;
+                if (stat.proven != Proven::NONE) {
+                    it->proven = stat.proven;
+                }
+            }
+        }
+    }
+    std::sort(stats.begin(), stats.end(), [](const MoveStat &a, const MoveStat &b) { return a.move < b.move; });
+    return stats;
+}
+
+std::pair<int, int> MonteCarloTreeSearch::SearchMoveLocked(const BoardState &board_state, Stone next_move_stone,
+    const SearchBudget &budget, tqdm *pbar, std::vector<std::tuple<int, int, double>> *move_win_ratio)
+{
+    auto time1 = std::chrono::steady_clock::now();
+    std::vector<MoveStat> stats = SolveEndgameLocked(board_state, next_move_stone, budget);
+    if (!stats.empty()) {
+        std::cout << "endgame solved" << std::endl;
+    } else {
+        // the solver does not apply or ran out of time, the search still returns a move
+        stats = RunSearchLocked(board_state, next_move_stone, budget, pbar);
+    }
+    auto time2 = std::chrono::steady_clock::now();
+    std::cout << "\nAI think time: " << std::chrono::duration<double>(time2 - time1).count() << "s" << std::endl;
+    if (stats.empty()) {
+        throw std::runtime_error("search position has no legal move");
+    }
+
+    int board_size = tree_board_size_;
+    const MoveStat *best = &stats[0];
+    uint32_t root_visit_count = 0;
+    // a proven win first and a proven loss last, the most visited move otherwise
+    auto rank = [](const MoveStat &stat) {
+        return std::make_tuple(stat.proven == Proven::WIN, stat.proven != Proven::LOSS, stat.visit_count,
+            stat.win_count);
+    };
+    for (const MoveStat &stat : stats) {
+        if (rank(stat) > rank(*best)) {
+            best = &stat;
+        }
+        root_visit_count += stat.visit_count;
+    }
+    std::cout << "win ratio: " << best->win_count << "/" << best->visit_count
+        << " = " << best->win_count / best->visit_count << std::endl;
+    for (const MoveStat &stat : stats) {
+        std::cout << "[" << static_cast<char>(stat.move / board_size + 'A') << stat.move % board_size
+            << ":" << stat.win_count << "/" << stat.visit_count << "=" << stat.win_count / stat.visit_count << "] ";
+    }
+    std::cout << "\nroot visit count: " << root_visit_count << std::endl;
+    if (move_win_ratio != nullptr) {
+        move_win_ratio->clear();
+        for (const MoveStat &stat : stats) {
+            if (stat.visit_count > 0) {
+                move_win_ratio->emplace_back(stat.move / board_size, stat.move % board_size,
+                    stat.win_count / stat.visit_count);
+            }
+        }
+    }
+    return {best->move / board_size, best->move % board_size};
+}
+
+void MonteCarloTreeSearch::AdvanceRoot(int place_x, int place_y)
+{
+    {
+        // a search that starts after this already sees the move, one running now is stopped
+        std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+        pending_moves_.emplace_back(place_x, place_y);
+        ++root_generation_;
+        search_stop_ = true;
+    }
+    StopPondering();
+}
+
+/**
+ * Clear the stop flag for a search of the position of root_generation, unless AdvanceRoot moved
+ * the game past it before the search got hold of mutex_.
+ */
+void MonteCarloTreeSearch::ResetSearchStopLocked(std::optional<uint64_t> root_generation)
+{
+    std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+    search_stop_ = root_generation != root_generation_.load();
+}
+
+/**
+ * Advance the trees by the moves AdvanceRoot queued since the last search.
+ */
+void MonteCarloTreeSearch::ApplyPendingMovesLocked()
+{
+    std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+    for (const auto &[place_x, place_y] : pending_moves_) {
+        for (auto &tree : trees_) {
+            tree->AdvanceRoot(place_x * tree_board_size_ + place_y);
+        }
+    }
+    pending_moves_.clear();
+}
+
+void MonteCarloTreeSearch::StartPondering(const BoardState &board_state, Stone next_move_stone, int simulation_limit)
+{
+    std::lock_guard<std::mutex> ponder_lock(ponder_mutex_);
+    ponder_stop_ = true;
+    if (ponder_thread_.joinable()) {
+        ponder_thread_.join();
+    }
+    ponder_stop_ = false;
+    ponder_thread_ = std::thread([this, board_state, next_move_stone, simulation_limit]() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // the reply will be solved without a search
+        if (options_.endgame_empties > 0 && CountEmpties(board_state) - 1 <= options_.endgame_empties) {
+            return;
+        }
+        RunSearchLocked(board_state, next_move_stone, SearchBudget(simulation_limit, ponder_stop_), nullptr);
+    });
+}
+
+void MonteCarloTreeSearch::StopPondering()
+{
+    std::lock_guard<std::mutex> ponder_lock(ponder_mutex_);
+    ponder_stop_ = true;
+    if (ponder_thread_.joinable()) {
+        ponder_thread_.join();
+    }
+}
+
+int MonteCarloTreeSearch::GetTreeNodesNumbers() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int count = 0;
+    for (const auto &tree : trees_) {
+        count += tree->GetTreeNodesNumbers();
+    }
+    return count;
+}
+
+int MonteCarloTreeSearch::GetTreeDepth() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int depth = 0;
+    for (const auto &tree : trees_) {
+        depth = std::max(depth, tree->GetTreeDepth());
+    }
+    return depth;
+}
+
+std::vector<int> MonteCarloTreeSearch::StatDepthNodesNumbers() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int> depth_nodes_numbers;
+    for (const auto &tree : trees_) {
+        auto tree_depth_nodes_numbers = tree->StatDepthNodesNumbers();
+        if (tree_depth_nodes_numbers.size() > depth_nodes_numbers.size()) {
+            depth_nodes_numbers.resize(tree_depth_nodes_numbers.size(), 0);
+        }
+        for (size_t depth = 0; depth < tree_depth_nodes_numbers.size(); ++depth) {
+            depth_nodes_numbers[depth] += tree_depth_nodes_numbers[depth];
+        }
+    }
+    return depth_nodes_numbers;
+}
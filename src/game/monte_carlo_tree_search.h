@@ -2,75 +2,836 @@
 #define __MONTE_CARLO_TREE_SEARCH_H__
 
 #include "game_const.h"
+#include "endgame_solver.h"
 
 #include <vector>
 #include <utility>
 #include <memory>
 #include <limits>
 #include <cmath>
-#include <queue>
-#include <iostream>
+#include <tuple>
+#include <cstdint>
+#include <optional>
+#include <mutex>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
-using GameState = std::vector<std::vector<Stone>>;
+class tqdm;
 
+/**
+ * Exploration term of UCB1 with constant sqrt(2) without the child's 1 / sqrt(visit_count)
+ * factor. It only depends on the parent, so selection computes it once per node.
+ */
+inline double UcbExploration(uint32_t parent_visit_count)
+{
+    const double coef = 1.4142135623730951; // sqrt(2)
+    return coef * std::sqrt(std::log(static_cast<double>(parent_visit_count)));
+}
+
+/**
+ * UCB1 priority of a move, win_count is from the side choosing the move and an unvisited move
+ * comes before any visited one.
+ */
+inline double UcbPriority(double win_count, uint32_t visit_count, double exploration)
+{
+    if (visit_count == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return (win_count + exploration * std::sqrt(static_cast<double>(visit_count))) / visit_count;
+}
+
+/**
+ * How playouts pick their moves. WEIGHTED draws moves in proportion to a weight per square class,
+ * corners first and the squares next to corners last, at the cost of a few popcounts per move.
+ */
+enum class PlayoutPolicy {
+    UNIFORM = 0,
+    WEIGHTED = 1
+};
+
+/**
+ * Game-theoretic value of a move for the side that played it, NONE until the search proves it.
+ */
+enum class Proven : uint8_t {
+    NONE = 0,
+    LOSS = 1,
+    DRAW = 2,
+    WIN = 3
+};
+
+inline Proven OpponentProven(Proven proven)
+{
+    if (proven == Proven::WIN) return Proven::LOSS;
+    if (proven == Proven::LOSS) return Proven::WIN;
+    return proven;
+}
+
+/**
+ * Offset of the highest UCB1 priority among count children whose statistics are stored side by
+ * side, the first one on ties. Proven children are skipped, at least one child should be unproven.
+ * Computed in single precision, four children at a time with SSE2.
+ */
+uint32_t UcbArgmax(const uint32_t *visit_counts, const uint32_t *half_wins, const Proven *proven, uint32_t count,
+    double exploration);
+
+/**
+ * Links and move of a node, its statistics are kept apart by NodePool. Nodes keep no position,
+ * the search replays the moves along the path on a scratch board. Children are materialized one
+ * at a time in increasing square order and live in one block, [first_child, first_child +
+ * num_children), so the untried moves of a node are its legal moves above the last child's square.
+ */
 struct TreeNode {
-    GameState state;
-    std::shared_ptr<TreeNode> parent = nullptr;
-    Stone next_move_stone;
-    std::pair<int, int> from_move;
+    static constexpr uint16_t square_mask = 0x3FFF;
+    static constexpr uint16_t fully_expanded_bit = 0x4000;
+    static constexpr uint16_t white_to_move_bit = 0x8000;
+    static constexpr int no_move = square_mask;
+
+    uint32_t first_child = 0;
+    uint16_t num_children = 0;
+    // square played by the parent's side to move, the top bits flag this node's side to move
+    // and that every legal move has a child
+    uint16_t move = no_move;
+
+    int FromMove() const { return move & square_mask; }
+
+    Stone NextMoveStone() const {
+        return (move & white_to_move_bit) ? Stone::WHITE : Stone::BLACK;
+    }
+
+    bool IsFullyExpanded() const { return move & fully_expanded_bit; }
+
+    void Set(int from_move, Stone next_move_stone) {
+        move = static_cast<uint16_t>(from_move | (next_move_stone == Stone::WHITE ? white_to_move_bit : 0));
+    }
+
+    void SetNextMoveStone(Stone next_move_stone) {
+        move = static_cast<uint16_t>((move & ~white_to_move_bit)
+            | (next_move_stone == Stone::WHITE ? white_to_move_bit : 0));
+    }
+
+    void SetFromMove(int from_move) {
+        move = static_cast<uint16_t>((move & ~square_mask) | from_move);
+    }
+
+    void MarkFullyExpanded() { move |= fully_expanded_bit; }
+};
+static_assert(sizeof(TreeNode) == 8, "tree node links should stay 8 bytes");
+
+/**
+ * All nodes of one search, linked by 32-bit indices with the root at index 0. The links and the
+ * statistics are separate arrays, so the visit and win counts of the children of a node are
+ * contiguous for UcbArgmax. Reset() drops the whole tree at once and keeps the memory for the
+ * next search. The all-moves-as-first (AMAF) counts of RAVE are only stored once enabled.
+ */
+class NodePool {
+public:
+    /**
+     * Store AMAF counts for every node, call it on an empty pool.
+     */
+    void SetAmafEnabled(bool enabled) { amaf_enabled_ = enabled; }
+    bool AmafEnabled() const { return amaf_enabled_; }
+
+    /**
+     * Append count default nodes and return the index of the first one, this may move the
+     * nodes so references into the pool do not survive it.
+     */
+    uint32_t Allocate(int count) {
+        auto first = static_cast<uint32_t>(nodes_.size());
+        nodes_.resize(nodes_.size() + count);
+        visit_counts_.resize(nodes_.size());
+        half_wins_.resize(nodes_.size());
+        proven_.resize(nodes_.size());
+        if (amaf_enabled_) {
+            amaf_visit_counts_.resize(nodes_.size());
+            amaf_half_wins_.resize(nodes_.size());
+        }
+        return first;
+    }
+
+    void Reset() {
+        nodes_.clear();
+        visit_counts_.clear();
+        half_wins_.clear();
+        proven_.clear();
+        amaf_visit_counts_.clear();
+        amaf_half_wins_.clear();
+    }
+
+    TreeNode &operator[](uint32_t index) { return nodes_[index]; }
+    const TreeNode &operator[](uint32_t index) const { return nodes_[index]; }
+    uint32_t Size() const { return static_cast<uint32_t>(nodes_.size()); }
+
+    uint32_t VisitCount(uint32_t index) const { return visit_counts_[index]; }
+    double WinCount(uint32_t index) const { return half_wins_[index] * 0.5; }
+    Proven GetProven(uint32_t index) const { return proven_[index]; }
+    const uint32_t *VisitCounts() const { return visit_counts_.data(); }
+    const uint32_t *HalfWins() const { return half_wins_.data(); }
+    const Proven *ProvenValues() const { return proven_.data(); }
+    const uint32_t *AmafVisitCounts() const { return amaf_visit_counts_.data(); }
+    const uint32_t *AmafHalfWins() const { return amaf_half_wins_.data(); }
+
+    void SetProven(uint32_t index, Proven proven) { proven_[index] = proven; }
+
+    void AddResults(uint32_t index, uint32_t count, uint32_t half_wins) {
+        visit_counts_[index] += count;
+        half_wins_[index] += half_wins;
+    }
+
+    void AddAmafResults(uint32_t index, uint32_t count, uint32_t half_wins) {
+        amaf_visit_counts_[index] += count;
+        amaf_half_wins_[index] += half_wins;
+    }
+
+    /**
+     * Copy the links and statistics of node src of pool from into node dst.
+     */
+    void CopyNode(uint32_t dst, const NodePool &from, uint32_t src) {
+        nodes_[dst] = from.nodes_[src];
+        visit_counts_[dst] = from.visit_counts_[src];
+        half_wins_[dst] = from.half_wins_[src];
+        proven_[dst] = from.proven_[src];
+        if (amaf_enabled_) {
+            amaf_visit_counts_[dst] = from.amaf_visit_counts_[src];
+            amaf_half_wins_[dst] = from.amaf_half_wins_[src];
+        }
+    }
+
+    void ClearNode(uint32_t index) {
+        nodes_[index] = TreeNode{};
+        visit_counts_[index] = 0;
+        half_wins_[index] = 0;
+        proven_[index] = Proven::NONE;
+        if (amaf_enabled_) {
+            amaf_visit_counts_[index] = 0;
+            amaf_half_wins_[index] = 0;
+        }
+    }
+
+private:
+    std::vector<TreeNode> nodes_;
+    std::vector<uint32_t> visit_counts_;
+    std::vector<uint32_t> half_wins_; // a win counts 2, a draw 1
+    std::vector<Proven> proven_; // for the side that played the node's move
+    bool amaf_enabled_ = false;
+    // playouts in which the node's move was played by the same side at any later ply, and their half wins
+    std::vector<uint32_t> amaf_visit_counts_;
+    std::vector<uint32_t> amaf_half_wins_;
+};
+
+/**
+ * Statistics of positions keyed by Zobrist hash with the side to move, in buckets of two entries.
+ * A new position takes an empty entry of its bucket, else one with fewer discs than the current
+ * root, which the game can not reach again, else the entry with fewer visits.
+ */
+class TranspositionTable {
+public:
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t bucket_size = 2;
+
+    struct Entry {
+        uint64_t key = 0; // 0 marks an empty entry
+        uint32_t visit_count = 0;
+        uint32_t half_wins = 0; // from the side that moved into the position, a win counts 2
+        uint32_t num_discs = 0;
 
-    std::vector<std::shared_ptr<TreeNode>> children;
-    int visit_count = 0;
-    double win_count = 0;
+        double WinCount() const { return half_wins * 0.5; }
+    };
 
-    TreeNode(const GameState &state, std::shared_ptr<TreeNode> parent, Stone next_move_stone,
-                const std::pair<int, int> &from_move) : state{state},
-                parent{parent}, next_move_stone{next_move_stone}, from_move{from_move} {
+    /**
+     * Drop every entry and hold size entries, rounded up to a power of two.
+     */
+    void Resize(uint32_t size) {
+        uint32_t capacity = bucket_size;
+        while (capacity < size) {
+            capacity *= 2;
+        }
+        entries_.assign(capacity, Entry{});
     }
 
-    double GetExploitPriority() {
-        if (parent == nullptr) {
-            return std::numeric_limits<double>::infinity();
+    uint32_t Find(uint64_t key) const {
+        uint32_t bucket = Bucket(key);
+        for (uint32_t slot = bucket; slot < bucket + bucket_size; ++slot) {
+            if (entries_[slot].key == key) {
+                return slot;
+            }
         }
-        return ComputeExploitPriority(parent->visit_count);
+        return npos;
     }
 
+    /**
+     * Store a new position with no visits and return its slot, min_live_discs is the disc count
+     * of the search root.
+     */
+    uint32_t Insert(uint64_t key, uint32_t num_discs, uint32_t min_live_discs) {
+        uint32_t bucket = Bucket(key);
+        uint32_t slot = bucket;
+        for (uint32_t k = bucket + 1; k < bucket + bucket_size; ++k) {
+            if (ReplaceRank(entries_[k], min_live_discs) < ReplaceRank(entries_[slot], min_live_discs)) {
+                slot = k;
+            }
+        }
+        entries_[slot] = Entry{key, 0, 0, num_discs};
+        return slot;
+    }
+
+    Entry &operator[](uint32_t slot) { return entries_[slot]; }
+    const Entry &operator[](uint32_t slot) const { return entries_[slot]; }
+    uint32_t Capacity() const { return static_cast<uint32_t>(entries_.size()); }
+
 private:
-    double ComputeExploitPriority(int parent_total_rounds) {
-        const double coef = 1.4142135623730951; // sqrt(2)
-        if (visit_count == 0) {
-            return std::numeric_limits<double>::infinity();
+    uint32_t Bucket(uint64_t key) const {
+        return static_cast<uint32_t>(key) & static_cast<uint32_t>(entries_.size() - bucket_size);
+    }
+
+    static uint64_t ReplaceRank(const Entry &entry, uint32_t min_live_discs) {
+        if (entry.key == 0) {
+            return 0;
+        }
+        if (entry.num_discs < min_live_discs) {
+            return 1;
         }
-        double win_ratio = win_count / visit_count;
-        double exploit = coef * std::sqrt(std::log<double>(parent_total_rounds) / visit_count);
-        return win_ratio + exploit;
+        return 2 + static_cast<uint64_t>(entry.visit_count);
+    }
+
+    std::vector<Entry> entries_;
+};
+
+/**
+ * Node of the tree that SharedSearchTree searches from several threads. stats packs the visit
+ * count above the half wins, so a visit and its result are updated by one atomic add. links
+ * packs the children block with the node's move and side to move, an expanding thread fills the
+ * children first and publishes them with one release store of links.
+ */
+struct SharedTreeNode {
+    static constexpr uint64_t one_visit = uint64_t{1} << 32;
+    static constexpr int move_shift = 32;
+    static constexpr uint64_t move_mask = 0x3FFF;
+    static constexpr uint64_t white_to_move_bit = uint64_t{1} << 46;
+    static constexpr uint64_t expanding_bit = uint64_t{1} << 47; // a thread is creating the children
+    static constexpr int num_children_shift = 48;
+    static constexpr int no_move = static_cast<int>(move_mask);
+
+    std::atomic<uint64_t> stats{0};
+    std::atomic<uint64_t> links{0};
+
+    static uint32_t VisitCount(uint64_t stats) { return static_cast<uint32_t>(stats >> 32); }
+    static uint32_t HalfWins(uint64_t stats) { return static_cast<uint32_t>(stats); }
+    static uint32_t FirstChild(uint64_t links) { return static_cast<uint32_t>(links); }
+    static int NumChildren(uint64_t links) { return static_cast<int>(links >> num_children_shift); }
+    static int FromMove(uint64_t links) { return static_cast<int>((links >> move_shift) & move_mask); }
+
+    static Stone NextMoveStone(uint64_t links) {
+        return (links & white_to_move_bit) ? Stone::WHITE : Stone::BLACK;
+    }
+
+    static uint64_t MakeLinks(int from_move, Stone next_move_stone) {
+        return (static_cast<uint64_t>(from_move) << move_shift)
+            | (next_move_stone == Stone::WHITE ? white_to_move_bit : 0);
     }
 };
+static_assert(sizeof(SharedTreeNode) == 16, "shared tree nodes should stay 16 bytes");
+
+/**
+ * Nodes of a SharedSearchTree in chunks that never move, so threads keep reading nodes while
+ * others allocate. Allocate takes a block with a compare and swap on the size, the mutex is only
+ * taken to create a chunk the first time it is used.
+ */
+class SharedNodePool {
+public:
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+    static constexpr int chunk_bits = 16;
+    static constexpr uint32_t chunk_size = uint32_t{1} << chunk_bits;
+    static constexpr uint32_t max_chunks = 1024;
+
+    SharedNodePool() = default;
+    SharedNodePool(const SharedNodePool &) = delete;
+    SharedNodePool &operator=(const SharedNodePool &) = delete;
+
+    ~SharedNodePool() {
+        for (auto &chunk : chunks_) {
+            delete[] chunk.load();
+        }
+    }
+
+    /**
+     * Reserve count nodes in one chunk and return the first, npos when the pool is full. The
+     * nodes keep the values of an earlier search, the caller initializes them.
+     */
+    uint32_t Allocate(uint32_t count);
+
+    /**
+     * Forget every node, the chunks are kept. No other thread may use the pool meanwhile.
+     */
+    void Reset() { size_.store(0); }
+
+    /**
+     * Nodes handed out so far, counting the ends of chunks skipped by Allocate.
+     */
+    uint32_t Size() const { return size_.load(); }
+
+    /**
+     * Exchange the nodes of two pools. No other thread may use either pool meanwhile.
+     */
+    void Swap(SharedNodePool &other) {
+        for (uint32_t i = 0; i < max_chunks; ++i) {
+            SharedTreeNode *chunk = chunks_[i].load();
+            chunks_[i].store(other.chunks_[i].load());
+            other.chunks_[i].store(chunk);
+        }
+        uint32_t size = size_.load();
+        size_.store(other.size_.load());
+        other.size_.store(size);
+    }
+
+    SharedTreeNode &operator[](uint32_t index) {
+        return chunks_[index >> chunk_bits].load(std::memory_order_acquire)[index & (chunk_size - 1)];
+    }
+
+    const SharedTreeNode &operator[](uint32_t index) const {
+        return chunks_[index >> chunk_bits].load(std::memory_order_acquire)[index & (chunk_size - 1)];
+    }
+
+private:
+    std::atomic<uint32_t> size_{0};
+    std::mutex chunk_mutex_;
+    std::atomic<SharedTreeNode *> chunks_[max_chunks] = {};
+};
+
+/**
+ * Visits of a root move and its wins for the side to move at the root.
+ */
+struct MoveStat {
+    int move;
+    uint32_t visit_count;
+    double win_count;
+    Proven proven = Proven::NONE;
+};
 
+/**
+ * Winners of the playouts run from one leaf, they are backed up together.
+ */
+struct PlayoutResults {
+    uint32_t count = 0;
+    uint32_t wins[2] = {}; // black, white
+    bool exact = false; // every result is the game-theoretic value of the leaf
+
+    void Add(Stone win_stone, uint32_t times = 1) {
+        count += times;
+        if (win_stone != Stone::EMPTY) {
+            wins[win_stone == Stone::WHITE ? 1 : 0] += times;
+        }
+    }
+
+    // a win of mover counts 2, a draw 1
+    uint32_t HalfWins(Stone mover) const {
+        uint32_t draws = count - wins[0] - wins[1];
+        return 2 * wins[mover == Stone::WHITE ? 1 : 0] + draws;
+    }
+};
+
+/**
+ * How long one search runs, a number of simulations and optionally a deadline. The clock is read
+ * once every clock_check_interval iterations, so a search overshoots its deadline by at most that
+ * many iterations. The first iteration always runs.
+ */
+class SearchBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int clock_check_interval = 4;
+
+    explicit SearchBudget(int simulation_count) : simulation_count_(simulation_count) {}
+
+    explicit SearchBudget(Clock::time_point deadline)
+        : simulation_count_(std::numeric_limits<int>::max()), deadline_(deadline) {}
+
+    /**
+     * At most simulation_count simulations, ending early once stop is set.
+     */
+    SearchBudget(int simulation_count, const std::atomic<bool> &stop)
+        : simulation_count_(simulation_count), stop_(&stop) {}
+
+    SearchBudget(Clock::time_point deadline, const std::atomic<bool> &stop)
+        : simulation_count_(std::numeric_limits<int>::max()), deadline_(deadline), stop_(&stop) {}
+
+    int SimulationCount() const { return simulation_count_; }
+    bool HasDeadline() const { return deadline_.has_value(); }
+
+    /**
+     * Limits that stop an EndgameSolver at the deadline or stop flag of this budget, or after
+     * max_nodes positions, 0 for no limit.
+     */
+    SolverLimits ToSolverLimits(uint64_t max_nodes = 0) const {
+        SolverLimits limits;
+        limits.max_nodes = max_nodes;
+        limits.deadline = deadline_;
+        limits.stop = stop_;
+        return limits;
+    }
+
+    /**
+     * The budget of one of num_workers workers searching separate trees.
+     */
+    SearchBudget Split(int num_workers) const {
+        SearchBudget result = *this;
+        if (!deadline_.has_value()) {
+            result.simulation_count_ = (simulation_count_ + num_workers - 1) / num_workers;
+        }
+        return result;
+    }
+
+    /**
+     * Call before every iteration with the simulations run so far.
+     */
+    bool Exhausted(int simulations_done) {
+        if (simulations_done == 0) {
+            return false;
+        }
+        if (simulations_done >= simulation_count_ || deadline_passed_) {
+            return true;
+        }
+        if (stop_ != nullptr && stop_->load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (deadline_.has_value() && ++iterations_since_clock_check_ >= clock_check_interval) {
+            iterations_since_clock_check_ = 0;
+            deadline_passed_ = Clock::now() >= *deadline_;
+        }
+        return deadline_passed_;
+    }
+
+private:
+    int simulation_count_;
+    std::optional<Clock::time_point> deadline_;
+    const std::atomic<bool> *stop_ = nullptr;
+    int iterations_since_clock_check_ = 0;
+    bool deadline_passed_ = false;
+};
+
+class SearchTreeBase {
+public:
+    virtual ~SearchTreeBase() = default;
+    /**
+     * Search from board_state until the budget is used up and return the statistics of the root
+     * moves, pbar may be null.
+     */
+    virtual std::vector<MoveStat> Search(const BoardState &board_state, Stone next_move_stone, SearchBudget budget,
+        tqdm *pbar) = 0;
+    virtual int GetTreeNodesNumbers() const = 0;
+    virtual int GetTreeDepth() const = 0;
+    virtual std::vector<int> StatDepthNodesNumbers() const = 0;
+    virtual void AdvanceRoot(int square) = 0;
+
+    /**
+     * Playouts run from every new leaf, each of them counts as a simulation.
+     */
+    void SetRolloutsPerLeaf(int rollouts_per_leaf) { rollouts_per_leaf_ = rollouts_per_leaf; }
+    void SetEndgameLeafEmpties(int empties) { endgame_leaf_empties_ = empties; }
+    void SetPlayoutPolicy(PlayoutPolicy policy) { playout_policy_ = policy; }
+    /**
+     * Blend the AMAF value of a move into its UCB value with weight sqrt(k / (3 n + k)) for n
+     * visits, so the two weigh the same at k visits. 0 turns RAVE off, only SearchTree keeps
+     * AMAF statistics.
+     */
+    void SetRaveEquivalence(int rave_equivalence) { rave_equivalence_ = rave_equivalence; }
+protected:
+    // a leaf solve that needs more positions is dropped for playouts, about 3 ms on 8x8
+    static constexpr uint64_t leaf_solver_max_nodes = 1 << 16;
+
+    int rollouts_per_leaf_ = 1;
+    int endgame_leaf_empties_ = 0; // new leaves with at most this many empty squares are solved, 0 for never
+    PlayoutPolicy playout_policy_ = PlayoutPolicy::UNIFORM;
+    int rave_equivalence_ = 0;
+    SolverLimits leaf_solver_limits_; // of the running search, set by Search
+};
+
+/**
+ * MCTS over one position type, see the explicit instantiations in monte_carlo_tree_search.cpp.
+ * Game ends and solved leaves are proven and their values propagate up as in MCTS-Solver: a node
+ * is won when one move wins, otherwise decided once every move is proven. Selection skips proven
+ * nodes and the search stops when the root is proven. With RAVE every node also counts, for each of
+ * its children, the playouts through the node in which the same side played the child's move later.
+ */
+template <class Board>
+class SearchTree : public SearchTreeBase {
+public:
+    using Node = TreeNode;
+    static constexpr uint32_t root = 0;
+
+    explicit SearchTree(unsigned seed) {
+        std::seed_seq seed_sequence{seed};
+        gen_.seed(seed_sequence);
+    }
+
+    std::vector<MoveStat> Search(const BoardState &board_state, Stone next_move_stone, SearchBudget budget,
+        tqdm *pbar) override;
+
+    int GetTreeNodesNumbers() const override {
+        return nodes_.Size() == 0 ? 0 : GetTreeNodesNumbers_(root);
+    }
+
+    int GetTreeDepth() const override {
+        return nodes_.Size() == 0 ? 0 : GetTreeDepth_(root);
+    }
+
+    std::vector<int> StatDepthNodesNumbers() const override;
+
+    /**
+     * Keep the subtree under the root child that played square and make it the new root, the tree
+     * is dropped if that child was never expanded.
+     */
+    void AdvanceRoot(int square) override;
+private:
+    bool Selection(Board &board);
+    uint32_t ExpandNode(uint32_t node_index, const Board &board);
+    uint32_t AddChild(uint32_t node_index, int move, Stone next_move_stone);
+    void BackPropagate(const PlayoutResults &results);
+    void UpdateAmaf(Stone winner, uint32_t count);
+    void PropagateProven(Proven leaf_proven);
+    Proven ProveNode(uint32_t node_index) const;
+    int GetTreeNodesNumbers_(uint32_t node_index) const;
+    int GetTreeDepth_(uint32_t node_index) const;
+    void CompactSubtree(uint32_t new_root);
+
+    NodePool nodes_;
+    NodePool spare_nodes_; // CompactSubtree copies the kept nodes here, then the pools swap
+    std::optional<Board> root_board_; // position of the root while nodes_ holds a tree
+    // nodes from the root to the current leaf, BackPropagate walks it backwards
+    std::vector<uint32_t> path_;
+    // moves applied to the scratch board since the root, undone after every iteration
+    std::vector<typename Board::MoveDelta> move_deltas_;
+    std::default_random_engine gen_;
+    std::optional<EndgameSolver<Board>> solver_; // created by the first leaf that is solved
+};
+
+/**
+ * MCTS over the graph of positions instead of the tree of move sequences. Nodes are entries of
+ * a TranspositionTable, so every move order reaching a position shares its statistics. Edges are
+ * not stored, the children of a node are looked up by the hashes of its legal moves. A simulation
+ * adds the result to each position of its path once. Positions can not repeat on a path since
+ * every move adds a disc, so this is the tree backup on an acyclic graph. The table outlives a
+ * search, which keeps the statistics of the positions the game moves into.
+ */
+template <class Board>
+class GraphSearch : public SearchTreeBase {
+public:
+    GraphSearch(uint32_t table_size, unsigned seed) : table_size_(table_size) {
+        std::seed_seq seed_sequence{seed};
+        gen_.seed(seed_sequence);
+    }
+
+    std::vector<MoveStat> Search(const BoardState &board_state, Stone next_move_stone, SearchBudget budget,
+        tqdm *pbar) override;
+
+    /**
+     * Positions in the table with at least as many discs as the last search root.
+     */
+    int GetTreeNodesNumbers() const override;
+
+    /**
+     * Plies from the last search root to its deepest stored position, passes not counted.
+     */
+    int GetTreeDepth() const override;
+
+    std::vector<int> StatDepthNodesNumbers() const override;
+
+    // the table is kept across moves, the next search finds its root among the stored positions
+    void AdvanceRoot(int) override {}
+private:
+    struct PathEntry {
+        uint32_t slot;
+        uint64_t key;
+        Stone mover; // side whose wins the position counts
+    };
+
+    void RunSimulation(Board &board, Stone next_move_stone);
+    int SelectMove(const Board &board, Stone next_move_stone, uint32_t parent_visit_count);
+    uint32_t FindOrInsert(const Board &board, Stone next_move_stone);
+    void BackPropagate(const PlayoutResults &results);
+
+    static uint32_t CountDiscs(const Board &board) {
+        return board.CountStone(Stone::BLACK) + board.CountStone(Stone::WHITE);
+    }
+
+    uint32_t table_size_;
+    uint32_t root_discs_ = 0;
+    TranspositionTable table_;
+    std::vector<PathEntry> path_;
+    std::vector<typename Board::MoveDelta> move_deltas_;
+    std::default_random_engine gen_;
+    std::optional<EndgameSolver<Board>> solver_; // created by the first leaf that is solved
+};
+
+/**
+ * One tree searched by several threads at once. A thread counts its visits on every node of its
+ * path while selecting, a virtual loss that steers the other threads to other branches until
+ * the result is added by BackPropagate. The first thread to reach an unexpanded node claims it
+ * with a compare and swap and creates all its children, a thread that finds the node claimed
+ * plays out from the node itself. AdvanceRoot keeps the subtree of the move played, like SearchTree.
+ */
+template <class Board>
+class SharedSearchTree : public SearchTreeBase {
+public:
+    SharedSearchTree(int num_threads, unsigned seed);
+
+    std::vector<MoveStat> Search(const BoardState &board_state, Stone next_move_stone, SearchBudget budget,
+        tqdm *pbar) override;
+
+    int GetTreeNodesNumbers() const override {
+        return has_tree_ ? GetTreeNodesNumbers_(root_) : 0;
+    }
+
+    int GetTreeDepth() const override {
+        return has_tree_ ? GetTreeDepth_(root_) : 0;
+    }
+
+    std::vector<int> StatDepthNodesNumbers() const override;
+
+    void AdvanceRoot(int square) override;
+private:
+    struct PathStep {
+        uint32_t node;
+        Stone mover; // side to move at the parent, whose wins the node counts
+    };
+
+    struct Worker {
+        std::vector<PathStep> path;
+        std::vector<typename Board::MoveDelta> move_deltas;
+        std::default_random_engine gen;
+        std::optional<EndgameSolver<Board>> solver;
+    };
+
+    void RunWorker(Worker &worker, Board board, SearchBudget budget, tqdm *pbar);
+    void CompactSubtree(uint32_t new_root);
+    void RunSimulation(Worker &worker, Board &board);
+    bool TryExpand(uint32_t node_index, const Board &board);
+    uint32_t SelectChild(uint32_t node_index, uint64_t links) const;
+    void BackPropagate(const Worker &worker, const PlayoutResults &results);
+    void CollectDepthNodesNumbers(uint32_t node_index, size_t depth, std::vector<int> &depth_nodes_numbers) const;
+    int GetTreeNodesNumbers_(uint32_t node_index) const;
+    int GetTreeDepth_(uint32_t node_index) const;
+
+    SharedNodePool pool_;
+    SharedNodePool spare_pool_; // CompactSubtree copies the kept subtree here, then swaps the pools
+    std::vector<uint32_t> compact_queue_;
+    uint32_t root_ = 0;
+    bool has_tree_ = false;
+    std::optional<Board> root_board_; // position of the root while has_tree_
+    std::atomic<int> next_simulation_{0};
+    std::vector<Worker> workers_;
+};
+
+/**
+ * Root parallel search, every worker thread grows its own tree from the same position with its
+ * own random stream and the visits and wins of the root moves are summed before picking the move.
+ * With Options::shared_tree the workers search one SharedSearchTree instead.
+ */
 class MonteCarloTreeSearch {
 public:
+    struct Options {
+        int threads = 1; // search workers, 0 for one per hardware thread
+        bool shared_tree = false; // the workers search one SharedSearchTree instead of a tree each
+        int rollouts_per_leaf = 1; // playouts from every new leaf, backed up at once
+        bool transpositions = false; // search the position graph with GraphSearch, one per worker
+        uint32_t transposition_table_size = 1 << 20; // entries shared by the workers, rounded up to a power of two
+        int endgame_empties = 0; // solve the root exactly from this many empty squares, 0 for never
+        int endgame_leaf_empties = 0; // solve new leaves exactly instead of playing them out, 0 for never
+        PlayoutPolicy playout_policy = PlayoutPolicy::UNIFORM;
+        int rave_equivalence = 0; // visits at which AMAF and UCB values weigh the same, 0 turns RAVE off
+    };
+
     MonteCarloTreeSearch() = default;
-    std::pair<int, int> SearchMove(const GameState &board_state, Stone next_move_stone, int simulation_count = 10000,
-        std::vector<std::tuple<int, int, double>> *move_win_ratio = nullptr);
+    ~MonteCarloTreeSearch() { StopPondering(); }
 
-    int GetTreeNodesNumbers() const {
-        return GetTreeNodesNumbers_(*root);
-    }
+    /**
+     * Replace the search options, the tree of the previous search is dropped.
+     */
+    void SetOptions(const Options &options);
+
+    /**
+     * Pick the position type specialized for board_size, call it once when the board size is known.
+     */
+    void SetBoardSize(int board_size);
+    /**
+     * Search from board_state, the simulations are split between the workers. The trees of the
+     * previous search are continued when their root has been advanced to this position.
+     * root_generation is the RootGeneration() board_state was taken at, the search ends after
+     * its first iteration when AdvanceRoot has been called since. It defaults to the generation
+     * at the call, pass it when the search runs on another thread than the one that plays the moves.
+     */
+    std::pair<int, int> SearchMove(const BoardState &board_state, Stone next_move_stone, int simulation_count = 10000,
+        std::vector<std::tuple<int, int, double>> *move_win_ratio = nullptr,
+        std::optional<uint64_t> root_generation = std::nullopt);
 
-    int GetTreeDepth() const {
-        return GetTreeDepth_(*root);
+    /**
+     * Search until deadline and return the best move found by then. The progress bar is not
+     * drawn, its setup would take from the budget.
+     */
+    std::pair<int, int> SearchMove(const BoardState &board_state, Stone next_move_stone,
+        SearchBudget::Clock::time_point deadline, std::vector<std::tuple<int, int, double>> *move_win_ratio = nullptr,
+        std::optional<uint64_t> root_generation = std::nullopt);
+
+    std::pair<int, int> SearchMove(const BoardState &board_state, Stone next_move_stone,
+        std::chrono::milliseconds time_budget, std::vector<std::tuple<int, int, double>> *move_win_ratio = nullptr,
+        std::optional<uint64_t> root_generation = std::nullopt) {
+        return SearchMove(board_state, next_move_stone, SearchBudget::Clock::now() + time_budget, move_win_ratio,
+            root_generation);
     }
 
+    /**
+     * Tell the search a move was played on the board so the tree follows the game. This does not
+     * wait for a running search: it stops the search, whose position is now behind the game, and
+     * the trees advance when the next search starts.
+     */
+    void AdvanceRoot(int place_x, int place_y);
+
+    /**
+     * Number of AdvanceRoot calls so far.
+     */
+    uint64_t RootGeneration() const { return root_generation_; }
+
+    /**
+     * Search board_state in the background until another call reaches the search or
+     * simulation_limit simulations are done. Call it when the opponent is to move, AdvanceRoot
+     * with their move then keeps the subtree for the next SearchMove.
+     */
+    void StartPondering(const BoardState &board_state, Stone next_move_stone, int simulation_limit);
+    void StopPondering();
+
+    /**
+     * Node counts are summed over the workers, the depth is the deepest tree.
+     */
+    int GetTreeNodesNumbers() const;
+    int GetTreeDepth() const;
     std::vector<int> StatDepthNodesNumbers() const;
 private:
-    std::shared_ptr<TreeNode> Selection();
-    void ExpandNode(const std::shared_ptr<TreeNode> &node);
-    void BackPropagate(const std::shared_ptr<TreeNode> &node, Stone win_stone);
-    Stone Simulate(const GameState &board_state, Stone next_move_stone);
-    std::pair<int, int> GetBestMove();
-    std::shared_ptr<TreeNode> root;
-    int GetTreeNodesNumbers_(const TreeNode &node) const;
-    int GetTreeDepth_(const TreeNode &node) const;
+    void SetBoardSizeLocked(int board_size);
+    void ApplyPendingMovesLocked();
+    void ResetSearchStopLocked(std::optional<uint64_t> root_generation);
+    int NumWorkers() const;
+    std::vector<MoveStat> SolveEndgameLocked(const BoardState &board_state, Stone next_move_stone,
+        const SearchBudget &budget) const;
+    std::vector<MoveStat> RunSearchLocked(const BoardState &board_state, Stone next_move_stone,
+        const SearchBudget &budget, tqdm *pbar);
+    std::pair<int, int> SearchMoveLocked(const BoardState &board_state, Stone next_move_stone, const SearchBudget &budget,
+        tqdm *pbar, std::vector<std::tuple<int, int, double>> *move_win_ratio);
+
+    Options options_;
+    // the game calls AdvanceRoot from the UI thread while a hint search may still run
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<SearchTreeBase>> trees_; // one per worker
+    int tree_board_size_ = 0;
+
+    // guards pending_moves_ and the writes of root_generation_ and search_stop_, never held while waiting for mutex_
+    std::mutex pending_mutex_;
+    std::vector<std::pair<int, int>> pending_moves_; // AdvanceRoot moves the trees have not followed yet
+    std::atomic<uint64_t> root_generation_{0};
+    std::atomic<bool> search_stop_{false}; // set by AdvanceRoot to end a SearchMove running meanwhile
+
+    std::mutex ponder_mutex_; // guards ponder_thread_, taken before mutex_
+    std::thread ponder_thread_;
+    std::atomic<bool> ponder_stop_{false};
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,241 @@
+#include "move_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define REVERSI_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define REVERSI_TARGET(isa) __attribute__((target(isa)))
+#else
+#define REVERSI_TARGET(isa)
+#endif
+
+namespace {
+    uint64_t ValidMovesScalar(uint64_t own, uint64_t opp, const MoveKernelTable &table)
+    {
+        uint64_t moves = 0;
+        for (int i = 0; i < 4; ++i) {
+            const int shift = static_cast<int>(table.shifts[i]);
+            uint64_t left_opp = opp & table.left_masks[i];
+            uint64_t right_opp = opp & table.right_masks[i];
+            uint64_t left_run = (own << shift) & left_opp;
+            uint64_t right_run = (own >> shift) & right_opp;
+            for (int step = 0; step < table.board_size - 3; ++step) {
+                left_run |= (left_run << shift) & left_opp;
+                right_run |= (right_run >> shift) & right_opp;
+            }
+            moves |= ((left_run << shift) & table.left_masks[i]) | ((right_run >> shift) & table.right_masks[i]);
+        }
+        return moves & ~(own | opp);
+    }
+
+    uint64_t FlipsScalar(int square, uint64_t own, uint64_t opp, const MoveKernelTable &table)
+    {
+        const uint64_t origin = uint64_t{1} << square;
+        uint64_t flips = 0;
+        for (int i = 0; i < 4; ++i) {
+            const int shift = static_cast<int>(table.shifts[i]);
+            uint64_t left_opp = opp & table.left_masks[i];
+            uint64_t right_opp = opp & table.right_masks[i];
+            uint64_t left_run = (origin << shift) & left_opp;
+            uint64_t right_run = (origin >> shift) & right_opp;
+            for (int step = 0; step < table.board_size - 3; ++step) {
+                left_run |= (left_run << shift) & left_opp;
+                right_run |= (right_run >> shift) & right_opp;
+            }
+            if ((left_run << shift) & table.left_masks[i] & own) flips |= left_run;
+            if ((right_run >> shift) & table.right_masks[i] & own) flips |= right_run;
+        }
+        return flips;
+    }
+
+#ifdef REVERSI_SIMD_X86
+    /**
+     * SSE2 has no per-lane shift counts, so lane 1 holds the bit reversed board where a
+     * right shift of the board becomes a left shift. Each shift amount then covers two directions.
+     */
+    REVERSI_TARGET("sse2")
+    uint64_t ValidMovesSse2(uint64_t own, uint64_t opp, const MoveKernelTable &table)
+    {
+        const __m128i own2 = _mm_set_epi64x(static_cast<long long>(ReverseBits(own)), static_cast<long long>(own));
+        const __m128i opp2 = _mm_set_epi64x(static_cast<long long>(ReverseBits(opp)), static_cast<long long>(opp));
+        __m128i moves2 = _mm_setzero_si128();
+        for (int i = 0; i < 4; ++i) {
+            const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(table.shifts[i]));
+            const __m128i mask = _mm_set_epi64x(static_cast<long long>(table.right_masks_rev[i]),
+                                                static_cast<long long>(table.left_masks[i]));
+            const __m128i opp_masked = _mm_and_si128(opp2, mask);
+            __m128i run = _mm_and_si128(_mm_sll_epi64(own2, shift), opp_masked);
+            for (int step = 0; step < table.board_size - 3; ++step) {
+                run = _mm_or_si128(run, _mm_and_si128(_mm_sll_epi64(run, shift), opp_masked));
+            }
+            moves2 = _mm_or_si128(moves2, _mm_and_si128(_mm_sll_epi64(run, shift), mask));
+        }
+        uint64_t moves = static_cast<uint64_t>(_mm_cvtsi128_si64(moves2));
+        uint64_t moves_rev = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(moves2, moves2)));
+        return (moves | ReverseBits(moves_rev)) & ~(own | opp);
+    }
+
+    REVERSI_TARGET("sse2")
+    uint64_t FlipsSse2(int square, uint64_t own, uint64_t opp, const MoveKernelTable &table)
+    {
+        const uint64_t origin = uint64_t{1} << square;
+        const __m128i origin2 = _mm_set_epi64x(static_cast<long long>(ReverseBits(origin)), static_cast<long long>(origin));
+        const __m128i own2 = _mm_set_epi64x(static_cast<long long>(ReverseBits(own)), static_cast<long long>(own));
+        const __m128i opp2 = _mm_set_epi64x(static_cast<long long>(ReverseBits(opp)), static_cast<long long>(opp));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i flips2 = zero;
+        for (int i = 0; i < 4; ++i) {
+            const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(table.shifts[i]));
+            const __m128i mask = _mm_set_epi64x(static_cast<long long>(table.right_masks_rev[i]),
+                                                static_cast<long long>(table.left_masks[i]));
+            const __m128i opp_masked = _mm_and_si128(opp2, mask);
+            __m128i run = _mm_and_si128(_mm_sll_epi64(origin2, shift), opp_masked);
+            for (int step = 0; step < table.board_size - 3; ++step) {
+                run = _mm_or_si128(run, _mm_and_si128(_mm_sll_epi64(run, shift), opp_masked));
+            }
+            __m128i bracket = _mm_and_si128(_mm_and_si128(_mm_sll_epi64(run, shift), mask), own2);
+            // SSE2 has no 64-bit compare, a lane is unbracketed when both of its 32-bit halves are zero
+            __m128i is_zero32 = _mm_cmpeq_epi32(bracket, zero);
+            __m128i is_zero64 = _mm_and_si128(is_zero32, _mm_shuffle_epi32(is_zero32, _MM_SHUFFLE(2, 3, 0, 1)));
+            flips2 = _mm_or_si128(flips2, _mm_andnot_si128(is_zero64, run));
+        }
+        uint64_t flips = static_cast<uint64_t>(_mm_cvtsi128_si64(flips2));
+        uint64_t flips_rev = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(flips2, flips2)));
+        return flips | ReverseBits(flips_rev);
+    }
+
+    REVERSI_TARGET("avx2")
+    uint64_t HorizontalOr(__m256i x)
+    {
+        __m128i half = _mm_or_si128(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+        half = _mm_or_si128(half, _mm_unpackhi_epi64(half, half));
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(half));
+    }
+
+    /**
+     * The four shift amounts sit in the four 64-bit lanes, one vector for left shifts and one
+     * for right shifts, so all eight directions advance with two variable shift instructions.
+     */
+    REVERSI_TARGET("avx2")
+    uint64_t ValidMovesAvx2(uint64_t own, uint64_t opp, const MoveKernelTable &table)
+    {
+        const __m256i shifts = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table.shifts));
+        const __m256i left_mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table.left_masks));
+        const __m256i right_mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table.right_masks));
+        const __m256i own4 = _mm256_set1_epi64x(static_cast<long long>(own));
+        const __m256i opp4 = _mm256_set1_epi64x(static_cast<long long>(opp));
+        const __m256i left_opp = _mm256_and_si256(opp4, left_mask);
+        const __m256i right_opp = _mm256_and_si256(opp4, right_mask);
+        __m256i left_run = _mm256_and_si256(_mm256_sllv_epi64(own4, shifts), left_opp);
+        __m256i right_run = _mm256_and_si256(_mm256_srlv_epi64(own4, shifts), right_opp);
+        for (int step = 0; step < table.board_size - 3; ++step) {
+            left_run = _mm256_or_si256(left_run, _mm256_and_si256(_mm256_sllv_epi64(left_run, shifts), left_opp));
+            right_run = _mm256_or_si256(right_run, _mm256_and_si256(_mm256_srlv_epi64(right_run, shifts), right_opp));
+        }
+        __m256i moves = _mm256_or_si256(_mm256_and_si256(_mm256_sllv_epi64(left_run, shifts), left_mask),
+                                        _mm256_and_si256(_mm256_srlv_epi64(right_run, shifts), right_mask));
+        return HorizontalOr(moves) & ~(own | opp);
+    }
+
+    REVERSI_TARGET("avx2")
+    uint64_t FlipsAvx2(int square, uint64_t own, uint64_t opp, const MoveKernelTable &table)
+    {
+        const __m256i shifts = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table.shifts));
+        const __m256i left_mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table.left_masks));
+        const __m256i right_mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table.right_masks));
+        const __m256i origin4 = _mm256_set1_epi64x(static_cast<long long>(uint64_t{1} << square));
+        const __m256i own4 = _mm256_set1_epi64x(static_cast<long long>(own));
+        const __m256i opp4 = _mm256_set1_epi64x(static_cast<long long>(opp));
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i left_opp = _mm256_and_si256(opp4, left_mask);
+        const __m256i right_opp = _mm256_and_si256(opp4, right_mask);
+        __m256i left_run = _mm256_and_si256(_mm256_sllv_epi64(origin4, shifts), left_opp);
+        __m256i right_run = _mm256_and_si256(_mm256_srlv_epi64(origin4, shifts), right_opp);
+        for (int step = 0; step < table.board_size - 3; ++step) {
+            left_run = _mm256_or_si256(left_run, _mm256_and_si256(_mm256_sllv_epi64(left_run, shifts), left_opp));
+            right_run = _mm256_or_si256(right_run, _mm256_and_si256(_mm256_srlv_epi64(right_run, shifts), right_opp));
+        }
+        __m256i left_bracket = _mm256_and_si256(_mm256_and_si256(_mm256_sllv_epi64(left_run, shifts), left_mask), own4);
+        __m256i right_bracket = _mm256_and_si256(_mm256_and_si256(_mm256_srlv_epi64(right_run, shifts), right_mask), own4);
+        left_run = _mm256_andnot_si256(_mm256_cmpeq_epi64(left_bracket, zero), left_run);
+        right_run = _mm256_andnot_si256(_mm256_cmpeq_epi64(right_bracket, zero), right_run);
+        return HorizontalOr(_mm256_or_si256(left_run, right_run));
+    }
+#endif
+
+    const MoveKernels kernels[] = {
+        {SimdLevel::SCALAR, "scalar", ValidMovesScalar, FlipsScalar},
+#ifdef REVERSI_SIMD_X86
+        {SimdLevel::SSE2, "sse2", ValidMovesSse2, FlipsSse2},
+        {SimdLevel::AVX2, "avx2", ValidMovesAvx2, FlipsAvx2},
+#endif
+    };
+    constexpr int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+}
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef REVERSI_SIMD_X86
+    unsigned int regs[4] = {0, 0, 0, 0}; // eax, ebx, ecx, edx
+    auto cpuid = [&regs](unsigned int leaf, unsigned int sub_leaf) {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, static_cast<int>(leaf), static_cast<int>(sub_leaf));
+        for (int i = 0; i < 4; ++i) regs[i] = static_cast<unsigned int>(info[i]);
+#else
+        __cpuid_count(leaf, sub_leaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    };
+    cpuid(0, 0);
+    unsigned int max_leaf = regs[0];
+    cpuid(1, 0);
+    bool has_sse2 = (regs[3] >> 26) & 1;
+    bool has_avx = (regs[2] >> 28) & 1;
+    bool has_osxsave = (regs[2] >> 27) & 1;
+    if (!has_sse2) {
+        return SimdLevel::SCALAR;
+    }
+    if (has_avx && has_osxsave && max_leaf >= 7) {
+        // XCR0 bits 1 and 2: the OS saves SSE and AVX registers on context switch
+#if defined(_MSC_VER)
+        uint64_t xcr0 = _xgetbv(0);
+#else
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        uint64_t xcr0 = (static_cast<uint64_t>(xcr0_hi) << 32) | xcr0_lo;
+#endif
+        cpuid(7, 0);
+        bool has_avx2 = (regs[1] >> 5) & 1;
+        if (has_avx2 && (xcr0 & 0x6) == 0x6) {
+            return SimdLevel::AVX2;
+        }
+    }
+    return SimdLevel::SSE2;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+const MoveKernels &GetMoveKernels(SimdLevel level)
+{
+    for (int i = num_kernels - 1; i > 0; --i) {
+        if (kernels[i].level <= level) {
+            return kernels[i];
+        }
+    }
+    return kernels[0];
+}
+
+const MoveKernels &ActiveMoveKernels()
+{
+    static const MoveKernels &active =
+        GetMoveKernels(DetectSimdLevel() >= SimdLevel::AVX2 ? SimdLevel::AVX2 : SimdLevel::SCALAR);
+    return active;
+}
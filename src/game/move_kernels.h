@@ -0,0 +1,89 @@
+#ifndef __MOVE_KERNELS_H__
+#define __MOVE_KERNELS_H__
+
+#include <cstdint>
+
+/**
+ * Move generation kernels for boards that fit in one 64-bit word (N <= 8), square (x, y) is
+ * bit x * N + y. The eight directions are four shift amounts {1, N - 1, N, N + 1} applied to
+ * the left and to the right, the SIMD kernels evaluate several of them per instruction.
+ */
+struct MoveKernelTable {
+    int board_size = 0;
+    uint64_t shifts[4] = {};
+    uint64_t left_masks[4] = {};       // squares a left shift by shifts[i] may land on
+    uint64_t right_masks[4] = {};      // squares a right shift by shifts[i] may land on
+    uint64_t right_masks_rev[4] = {};  // right_masks bit reversed, for kernels working on mirrored boards
+    uint64_t board_mask = 0;
+};
+
+constexpr uint64_t ReverseBits(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+    x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+    return (x >> 32) | (x << 32);
+}
+
+template <int N>
+constexpr MoveKernelTable MakeMoveKernelTable()
+{
+    static_assert(N * N <= 64, "move kernels work on single word boards");
+    MoveKernelTable table;
+    table.board_size = N;
+    uint64_t board = 0, not_first_col = 0, not_last_col = 0;
+    for (int x = 0; x < N; ++x) {
+        for (int y = 0; y < N; ++y) {
+            uint64_t bit = uint64_t{1} << (x * N + y);
+            board |= bit;
+            if (y != 0) not_first_col |= bit;
+            if (y != N - 1) not_last_col |= bit;
+        }
+    }
+    // left shift by 1 and N + 1 step to y + 1, by N - 1 steps to y - 1, by N keeps y
+    const uint64_t shifts[4] = {1, N - 1, N, N + 1};
+    const uint64_t left_masks[4] = {not_first_col, not_last_col, board, not_first_col};
+    const uint64_t right_masks[4] = {not_last_col, not_first_col, board, not_last_col};
+    for (int i = 0; i < 4; ++i) {
+        table.shifts[i] = shifts[i];
+        table.left_masks[i] = left_masks[i];
+        table.right_masks[i] = right_masks[i];
+        table.right_masks_rev[i] = ReverseBits(right_masks[i]);
+    }
+    table.board_mask = board;
+    return table;
+}
+
+enum class SimdLevel {
+    SCALAR = 0,
+    SSE2 = 1,
+    AVX2 = 2
+};
+
+struct MoveKernels {
+    SimdLevel level;
+    const char *name;
+    uint64_t (*valid_moves)(uint64_t own, uint64_t opp, const MoveKernelTable &table);
+    uint64_t (*flips)(int square, uint64_t own, uint64_t opp, const MoveKernelTable &table);
+};
+
+/**
+ * Highest level supported by both the CPU (CPUID) and the OS (XSAVE state for AVX).
+ */
+SimdLevel DetectSimdLevel();
+
+/**
+ * Kernels of the given level, falls back to a lower level when it was not compiled in.
+ */
+const MoveKernels &GetMoveKernels(SimdLevel level);
+
+/**
+ * Kernels picked once from DetectSimdLevel(): AVX2 when the CPU has it, the scalar level otherwise.
+ * The SSE2 kernels lose to the inlined Board<N> path (see bench_movegen), Board<N> keeps its own
+ * path whenever the scalar level is active.
+ */
+const MoveKernels &ActiveMoveKernels();
+
+#endif
@@ -0,0 +1,87 @@
+#include "multi_bitboard.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+const MultiBitBoard::Geometry &MultiBitBoard::GetGeometry(int board_size)
+{
+    static const std::array<Geometry, max_board_size + 1> geometries = []() {
+        std::array<Geometry, max_board_size + 1> result;
+        for (int n = 1; n <= max_board_size; ++n) {
+            Geometry &geo = result[n];
+            geo.size = n;
+            geo.num_words = (n * n + 63) / 64;
+            geo.ray_lengths.resize(n * n);
+            int d = 0;
+            for (int dx = -1; dx <= 1; ++dx) {
+                for (int dy = -1; dy <= 1; ++dy) {
+                    if (dx == 0 && dy == 0) {
+                        continue;
+                    }
+                    geo.shifts[d] = dx * n + dy;
+                    for (int x = 0; x < n; ++x) {
+                        for (int y = 0; y < n; ++y) {
+                            if (y - dy >= 0 && y - dy < n) {
+                                geo.masks[d].Set(x * n + y);
+                            }
+                            int reach_x = dx > 0 ? n - 1 - x : (dx < 0 ? x : n);
+                            int reach_y = dy > 0 ? n - 1 - y : (dy < 0 ? y : n);
+                            geo.ray_lengths[x * n + y][d] = static_cast<uint8_t>(std::min(reach_x, reach_y));
+                        }
+                    }
+                    ++d;
+                }
+            }
+            for (int square = 0; square < n * n; ++square) {
+                geo.board.Set(square);
+            }
+        }
+        return result;
+    }();
+    if (board_size < 1 || board_size > max_board_size) {
+        throw std::runtime_error("MultiBitBoard supports board size up to 32");
+    }
+    return geometries[board_size];
+}
+
+MultiBitBoard MultiBitBoard::InitialBoard(int board_size)
+{
+    MultiBitBoard board(board_size);
+    int center = board_size / 2 - 1;
+    board.black.Set(board.Square(center, center));
+    board.black.Set(board.Square(center + 1, center + 1));
+    board.white.Set(board.Square(center + 1, center));
+    board.white.Set(board.Square(center, center + 1));
+    board.RebuildIncrementalState();
+    return board;
+}
+
+MultiBitBoard MultiBitBoard::FromBoardState(const BoardState &board_state)
+{
+    int board_size = static_cast<int>(board_state.size());
+    MultiBitBoard board(board_size);
+    for (int x = 0; x < board_size; ++x) {
+        for (int y = 0; y < board_size; ++y) {
+            if (board_state[x][y] == Stone::BLACK) {
+                board.black.Set(board.Square(x, y));
+            } else if (board_state[x][y] == Stone::WHITE) {
+                board.white.Set(board.Square(x, y));
+            }
+        }
+    }
+    board.RebuildIncrementalState();
+    return board;
+}
+
+BoardState MultiBitBoard::ToBoardState() const
+{
+    int board_size = Size();
+    BoardState board_state(board_size, std::vector<Stone>(board_size, Stone::EMPTY));
+    for (int x = 0; x < board_size; ++x) {
+        for (int y = 0; y < board_size; ++y) {
+            board_state[x][y] = GetStone(Square(x, y));
+        }
+    }
+    return board_state;
+}
@@ -0,0 +1,271 @@
+#ifndef __MULTI_BITBOARD_H__
+#define __MULTI_BITBOARD_H__
+
+#include "game_const.h"
+#include "bit_mask.h"
+#include "zobrist.h"
+
+#include <cstdint>
+#include <array>
+#include <vector>
+
+/**
+ * Packed position for runtime board sizes up to 32x32. Square (x, y) is bit x * size + y
+ * of a multi-word mask, moves and flips use word shifts masked at the board edges.
+ */
+class MultiBitBoard {
+public:
+    static constexpr int max_board_size = 32;
+    static constexpr int max_words = (max_board_size * max_board_size + 63) / 64;
+    static_assert(max_board_size <= zobrist::max_board_size, "zobrist keys must cover every square");
+    using Mask = WideMask<max_words>;
+
+    static MultiBitBoard InitialBoard(int board_size);
+    static MultiBitBoard FromBoardState(const BoardState &board_state);
+    BoardState ToBoardState() const;
+
+    int Size() const { return geometry_->size; }
+    int Square(int x, int y) const { return x * geometry_->size + y; }
+
+    Stone GetStone(int square) const {
+        if (TestBit(black, square)) return Stone::BLACK;
+        if (TestBit(white, square)) return Stone::WHITE;
+        return Stone::EMPTY;
+    }
+
+    Mask GetValidMoves(Stone stone) const {
+        return stone == Stone::BLACK ? ComputeValidMoves(black, white, frontier)
+                                     : ComputeValidMoves(white, black, frontier);
+    }
+
+    Mask GetFlips(int square, Stone stone) const {
+        return stone == Stone::BLACK ? ComputeFlips(square, black, white) : ComputeFlips(square, white, black);
+    }
+
+    /**
+     * Squares changed by one placement, UnmakeMove restores the position from it.
+     */
+    struct MoveDelta {
+        Mask flips;
+        Mask frontier;
+        uint64_t hash;
+        int square = -1;
+        Stone stone = Stone::EMPTY;
+    };
+
+    MoveDelta MakeMove(int square, Stone stone) {
+        const Geometry &geo = *geometry_;
+        MoveDelta delta{GetFlips(square, stone), frontier, hash, square, stone};
+        Mask &own = stone == Stone::BLACK ? black : white;
+        Mask &opp = stone == Stone::BLACK ? white : black;
+        for (int i = 0; i < geo.num_words; ++i) {
+            own.words[i] |= delta.flips.words[i];
+            opp.words[i] &= ~delta.flips.words[i];
+        }
+        own.Set(square);
+        int num_flips = 0;
+        for (int i = 0; i < geo.num_words; ++i) {
+            num_flips += CountBits(delta.flips.words[i]);
+        }
+        disc_counts_[StoneIndex(stone)] += num_flips + 1;
+        disc_counts_[1 - StoneIndex(stone)] -= num_flips;
+        hash ^= zobrist::StoneKey(stone, square) ^ FlipsHash(delta.flips);
+        // flips keep the occupancy, only the empty neighbors of square join the frontier
+        frontier.Reset(square);
+        for (int d = 0; d < 8; ++d) {
+            if (geo.ray_lengths[square][d] > 0) {
+                int pos = square + geo.shifts[d];
+                if (!TestBit(black, pos) && !TestBit(white, pos)) {
+                    frontier.Set(pos);
+                }
+            }
+        }
+        return delta;
+    }
+
+    void UnmakeMove(const MoveDelta &delta) {
+        Mask &own = delta.stone == Stone::BLACK ? black : white;
+        Mask &opp = delta.stone == Stone::BLACK ? white : black;
+        int num_flips = 0;
+        for (int i = 0; i < geometry_->num_words; ++i) {
+            own.words[i] &= ~delta.flips.words[i];
+            opp.words[i] |= delta.flips.words[i];
+            frontier.words[i] = delta.frontier.words[i];
+            num_flips += CountBits(delta.flips.words[i]);
+        }
+        own.Reset(delta.square);
+        hash = delta.hash;
+        disc_counts_[StoneIndex(delta.stone)] -= num_flips + 1;
+        disc_counts_[1 - StoneIndex(delta.stone)] += num_flips;
+    }
+
+    /**
+     * Zobrist hash of the position with next_move_stone to move.
+     */
+    uint64_t Hash(Stone next_move_stone) const {
+        return hash ^ zobrist::SideKey(next_move_stone);
+    }
+
+    /**
+     * Hash(OpponentStone(stone)) after stone plays square, without making the move.
+     */
+    uint64_t HashAfterMove(int square, Stone stone) const {
+        return hash ^ zobrist::StoneKey(stone, square) ^ FlipsHash(GetFlips(square, stone))
+            ^ zobrist::SideKey(OpponentStone(stone));
+    }
+
+    void PlaceStone(int square, Stone stone) {
+        MakeMove(square, stone);
+    }
+
+    int CountStone(Stone stone) const {
+        return disc_counts_[StoneIndex(stone)];
+    }
+
+    Stone GetWinner() const {
+        int black_count = disc_counts_[0];
+        int white_count = disc_counts_[1];
+        if (black_count == white_count) return Stone::EMPTY;
+        return black_count > white_count ? Stone::BLACK : Stone::WHITE;
+    }
+
+    bool IsGameOver() const {
+        return IsEmpty(GetValidMoves(Stone::BLACK)) && IsEmpty(GetValidMoves(Stone::WHITE));
+    }
+
+    Mask black;
+    Mask white;
+    Mask frontier; // empty squares next to a disc, every legal move is one of them
+    uint64_t hash = 0; // Zobrist hash of the discs, see Hash()
+
+private:
+    void RebuildIncrementalState() {
+        frontier = ComputeFrontier();
+        hash = zobrist::keys.sizes[geometry_->size];
+        ForEachBit(black, [&](int square) { hash ^= zobrist::StoneKey(Stone::BLACK, square); });
+        ForEachBit(white, [&](int square) { hash ^= zobrist::StoneKey(Stone::WHITE, square); });
+        disc_counts_[0] = CountBits(black);
+        disc_counts_[1] = CountBits(white);
+    }
+
+    static int StoneIndex(Stone stone) {
+        return stone == Stone::WHITE ? 1 : 0;
+    }
+
+    uint64_t FlipsHash(const Mask &flips) const {
+        uint64_t result = 0;
+        for (int i = 0; i < geometry_->num_words; ++i) {
+            uint64_t word = flips.words[i];
+            while (word) {
+                result ^= zobrist::keys.flips[(i << 6) + PopLowestBit(word)];
+            }
+        }
+        return result;
+    }
+
+    struct Geometry {
+        int size = 0;
+        int num_words = 0;
+        int shifts[8] = {};
+        Mask masks[8]; // squares a step in each direction may land on
+        Mask board;
+        std::vector<std::array<uint8_t, 8>> ray_lengths; // squares to the edge from each square, per direction
+    };
+    static const Geometry &GetGeometry(int board_size);
+
+    explicit MultiBitBoard(int board_size) : geometry_{&GetGeometry(board_size)} {}
+
+    void Shift(const uint64_t *src, uint64_t *dst, int shift) const {
+        const int num_words = geometry_->num_words;
+        if (shift > 0) {
+            for (int i = num_words - 1; i > 0; --i) {
+                dst[i] = (src[i] << shift) | (src[i - 1] >> (64 - shift));
+            }
+            dst[0] = src[0] << shift;
+        } else {
+            shift = -shift;
+            for (int i = 0; i < num_words - 1; ++i) {
+                dst[i] = (src[i] >> shift) | (src[i + 1] << (64 - shift));
+            }
+            dst[num_words - 1] = src[num_words - 1] >> shift;
+        }
+    }
+
+    Mask ComputeValidMoves(const Mask &own, const Mask &opp, const Mask &candidates) const {
+        const Geometry &geo = *geometry_;
+        const int num_words = geo.num_words;
+        Mask moves;
+        uint64_t opp_masked[max_words], run[max_words], next[max_words];
+        for (int d = 0; d < 8; ++d) {
+            const uint64_t *dir_mask = geo.masks[d].words.data();
+            uint64_t any = 0;
+            Shift(own.words.data(), run, geo.shifts[d]);
+            for (int i = 0; i < num_words; ++i) {
+                opp_masked[i] = opp.words[i] & dir_mask[i];
+                run[i] &= opp_masked[i];
+                any |= run[i];
+            }
+            for (int step = 0; any && step < geo.size - 3; ++step) {
+                Shift(run, next, geo.shifts[d]);
+                any = 0;
+                for (int i = 0; i < num_words; ++i) {
+                    uint64_t grown = next[i] & opp_masked[i] & ~run[i];
+                    run[i] |= grown;
+                    any |= grown;
+                }
+            }
+            Shift(run, next, geo.shifts[d]);
+            for (int i = 0; i < num_words; ++i) {
+                moves.words[i] |= next[i] & dir_mask[i] & candidates.words[i];
+            }
+        }
+        return moves;
+    }
+
+    Mask ComputeFrontier() const {
+        const Geometry &geo = *geometry_;
+        const int num_words = geo.num_words;
+        Mask frontier_mask;
+        uint64_t occupied[max_words], next[max_words];
+        for (int i = 0; i < num_words; ++i) {
+            occupied[i] = black.words[i] | white.words[i];
+        }
+        for (int d = 0; d < 8; ++d) {
+            Shift(occupied, next, geo.shifts[d]);
+            for (int i = 0; i < num_words; ++i) {
+                frontier_mask.words[i] |= next[i] & geo.masks[d].words[i];
+            }
+        }
+        for (int i = 0; i < num_words; ++i) {
+            frontier_mask.words[i] &= ~occupied[i] & geo.board.words[i];
+        }
+        return frontier_mask;
+    }
+
+    Mask ComputeFlips(int square, const Mask &own, const Mask &opp) const {
+        const Geometry &geo = *geometry_;
+        Mask flips;
+        for (int d = 0; d < 8; ++d) {
+            const int shift = geo.shifts[d];
+            const int ray_length = geo.ray_lengths[square][d];
+            int pos = square + shift;
+            int length = 0;
+            while (length < ray_length && TestBit(opp, pos)) {
+                pos += shift;
+                ++length;
+            }
+            if (length > 0 && length < ray_length && TestBit(own, pos)) {
+                while (length-- > 0) {
+                    pos -= shift;
+                    flips.Set(pos);
+                }
+            }
+        }
+        return flips;
+    }
+
+    const Geometry *geometry_;
+    int disc_counts_[2] = {}; // black, white
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "reversi_game.h"
 #include "monte_carlo_tree_search.h"
+#include "board.h"
 
 #include <fstream>
 #include <iostream>
@@ -7,6 +8,33 @@
 #include <utility>
 #include <thread>
 
+namespace {
+    template <class Board>
+    std::vector<std::pair<int, int>> ListValidMoves(const Board &board, Stone player_stone)
+    {
+        std::vector<std::pair<int, int>> valid_moves;
+        int board_size = board.Size();
+        ForEachBit(board.GetValidMoves(player_stone), [&](int square) {
+            valid_moves.emplace_back(square / board_size, square % board_size);
+        });
+        return valid_moves;
+    }
+
+    template <class Board>
+    MultiBitBoard::Mask ApplyPlacementStone(std::vector<std::vector<Stone>> &board_state, const Board &board,
+                                            int place_x, int place_y, Stone place_stone)
+    {
+        int board_size = board.Size();
+        MultiBitBoard::Mask flips;
+        board_state[place_x][place_y] = place_stone;
+        ForEachBit(board.GetFlips(board.Square(place_x, place_y), place_stone), [&](int square) {
+            board_state[square / board_size][square % board_size] = place_stone;
+            flips.Set(square);
+        });
+        return flips;
+    }
+}
+
 void ReversiGame::MainLoop()
 {
     auto [win_pos, win_sz] = game_ui.DrawMainPanel(*this);
@@ -100,7 +128,87 @@ void ReversiGame::LoadConfig()
 
     if (config["board_size"]) {
         board_size_ = config["board_size"].as<int>();
+        if (board_size_ < 4 || board_size_ > MultiBitBoard::max_board_size) {
+            throw std::runtime_error("board_size should be in range [4, 32]");
+        }
     }
+
+    if (config["mcts"]) {
+        const auto &node_mcts = config["mcts"];
+        if (node_mcts["threads"]) {
+            mcts_options_.threads = node_mcts["threads"].as<int>();
+            if (mcts_options_.threads < 0) {
+                throw std::runtime_error("mcts threads should be 0 or positive");
+            }
+        }
+        if (node_mcts["shared_tree"]) {
+            mcts_options_.shared_tree = node_mcts["shared_tree"].as<bool>();
+        }
+        if (node_mcts["rollouts_per_leaf"]) {
+            mcts_options_.rollouts_per_leaf = node_mcts["rollouts_per_leaf"].as<int>();
+            if (mcts_options_.rollouts_per_leaf < 1) {
+                throw std::runtime_error("mcts rollouts_per_leaf should be at least 1");
+            }
+        }
+        if (node_mcts["transpositions"]) {
+            mcts_options_.transpositions = node_mcts["transpositions"].as<bool>();
+        }
+        if (node_mcts["transposition_table_size"]) {
+            int table_size = node_mcts["transposition_table_size"].as<int>();
+            if (table_size < 2) {
+                throw std::runtime_error("mcts transposition_table_size should be at least 2");
+            }
+            mcts_options_.transposition_table_size = static_cast<uint32_t>(table_size);
+        }
+        if (node_mcts["endgame_empties"]) {
+            mcts_options_.endgame_empties = node_mcts["endgame_empties"].as<int>();
+            if (mcts_options_.endgame_empties < 0 || mcts_options_.endgame_empties > max_config_solver_empties) {
+                throw std::runtime_error("mcts endgame_empties should be from 0 to "
+                    + std::to_string(max_config_solver_empties));
+            }
+        }
+        if (node_mcts["endgame_leaf_empties"]) {
+            mcts_options_.endgame_leaf_empties = node_mcts["endgame_leaf_empties"].as<int>();
+            if (mcts_options_.endgame_leaf_empties < 0
+                || mcts_options_.endgame_leaf_empties > max_config_solver_empties) {
+                throw std::runtime_error("mcts endgame_leaf_empties should be from 0 to "
+                    + std::to_string(max_config_solver_empties));
+            }
+        }
+        if (node_mcts["playout_policy"]) {
+            auto policy = node_mcts["playout_policy"].as<std::string>();
+            if (policy == "uniform") {
+                mcts_options_.playout_policy = PlayoutPolicy::UNIFORM;
+            } else if (policy == "weighted") {
+                mcts_options_.playout_policy = PlayoutPolicy::WEIGHTED;
+            } else {
+                throw std::runtime_error("mcts playout_policy should be uniform or weighted");
+            }
+        }
+        if (node_mcts["rave_equivalence"]) {
+            mcts_options_.rave_equivalence = node_mcts["rave_equivalence"].as<int>();
+            if (mcts_options_.rave_equivalence < 0) {
+                throw std::runtime_error("mcts rave_equivalence should be 0 or positive");
+            }
+        }
+        if (node_mcts["ponder"]) {
+            ponder_ = node_mcts["ponder"].as<bool>();
+        }
+        if (node_mcts["ponder_simulations"]) {
+            ponder_iter_steps_ = node_mcts["ponder_simulations"].as<int>();
+            if (ponder_iter_steps_ < 1) {
+                throw std::runtime_error("mcts ponder_simulations should be at least 1");
+            }
+        }
+        if (node_mcts["think_time_ms"]) {
+            think_time_ms_ = node_mcts["think_time_ms"].as<int>();
+            if (think_time_ms_ < 0) {
+                throw std::runtime_error("mcts think_time_ms should be 0 or positive");
+            }
+        }
+    }
+    mcts_.SetOptions(mcts_options_);
+    mcts_.SetBoardSize(board_size_);
 }
 
 void ReversiGame::DumpConfig(const char *dump_config_filename)
@@ -111,6 +219,20 @@ void ReversiGame::DumpConfig(const char *dump_config_filename)
 
     node["board_size"] = board_size_;
 
+    auto node_mcts = node["mcts"];
+    node_mcts["threads"] = mcts_options_.threads;
+    node_mcts["shared_tree"] = mcts_options_.shared_tree;
+    node_mcts["rollouts_per_leaf"] = mcts_options_.rollouts_per_leaf;
+    node_mcts["transpositions"] = mcts_options_.transpositions;
+    node_mcts["transposition_table_size"] = mcts_options_.transposition_table_size;
+    node_mcts["endgame_empties"] = mcts_options_.endgame_empties;
+    node_mcts["endgame_leaf_empties"] = mcts_options_.endgame_leaf_empties;
+    node_mcts["playout_policy"] = mcts_options_.playout_policy == PlayoutPolicy::WEIGHTED ? "weighted" : "uniform";
+    node_mcts["rave_equivalence"] = mcts_options_.rave_equivalence;
+    node_mcts["think_time_ms"] = think_time_ms_;
+    node_mcts["ponder"] = ponder_;
+    node_mcts["ponder_simulations"] = ponder_iter_steps_;
+
     std::ofstream fout{dump_config_filename};
     fout << node << std::endl;
 }
@@ -126,11 +248,11 @@ void ReversiGame::ResetIsMoveValid()
 void ReversiGame::GameConclude()
 {
     game_state_ = GameState::GAME_OVER;
-    if (count_black_ == count_white_) {
+    Stone winner = GetGameWinner(board_state_);
+    if (winner == Stone::EMPTY) {
         hint_text_ = "Game Draw";
-    } else if ((this_game_player_first && count_black_ > count_white_) ||
-               (!this_game_player_first && count_white_ > count_black_)) {
-        hint_text_ = hint_player_win;        
+    } else if (winner == (this_game_player_first ? Stone::BLACK : Stone::WHITE)) {
+        hint_text_ = hint_player_win;
     } else {
         hint_text_ = hint_player_loss;
     }
@@ -140,10 +262,13 @@ void ReversiGame::GameConclude()
 void ReversiGame::PlaceStone(int grid_x, int grid_y)
 {
     hint_player_move = false;
-    UpdateBoardWithPlacementStone(board_state_, grid_x, grid_y, next_move_stone_);
-    UpdateStoneCount();
-    record_move_.emplace_back(grid_x, grid_y);
-    record_board_state_.emplace_back(board_state_);
+    ++position_version_;
+    auto delta = MakePlacementStone(board_state_, grid_x, grid_y, next_move_stone_);
+    mcts_.AdvanceRoot(grid_x, grid_y);
+    history_.Push(board_state_, delta);
+    int num_flips = CountBits(delta.flips);
+    (next_move_stone_ == Stone::BLACK ? count_black_ : count_white_) += num_flips + 1;
+    (next_move_stone_ == Stone::BLACK ? count_white_ : count_black_) -= num_flips;
 
     Stone opp_stone = GetOpponentStone(next_move_stone_);
     valid_moves_ = GetValidMoves(opp_stone, board_state_);
@@ -157,6 +282,8 @@ void ReversiGame::PlaceStone(int grid_x, int grid_y)
         is_player_turn_ = !is_player_turn_;
         next_move_stone_ = opp_stone;
     }
+    // also after the AI passes, the player then moves again
+    StartPonderingOnPlayerTurn();
     hint_text_ = is_player_turn_ ? hint_players_turn : hint_computer_turn;
     ResetIsMoveValid();
 }
@@ -204,8 +331,14 @@ void ReversiGame::SearchMove(bool place_stone)
         th.join();
     }
     ai_think_threads_.clear();
-    ai_think_threads_.emplace_back(std::thread([this, place_stone]() mutable {
-        auto move = mcts_.SearchMove(board_state_, next_move_stone_, monte_carlo_iter_steps_, &hint_move_win_ratio);
+    // the player may move while a hint is searched, so the thread works on a copy of the position
+    ai_think_threads_.emplace_back(std::thread([this, place_stone, board_state = board_state_,
+                                                stone = next_move_stone_, version = position_version_.load(),
+                                                root_generation = mcts_.RootGeneration()]() {
+        auto move = think_time_ms_ > 0
+            ? mcts_.SearchMove(board_state, stone, std::chrono::milliseconds(think_time_ms_), &hint_move_win_ratio,
+                root_generation)
+            : mcts_.SearchMove(board_state, stone, monte_carlo_iter_steps_, &hint_move_win_ratio, root_generation);
         std::cout << "num nodes: " << mcts_.GetTreeNodesNumbers() << std::endl;
         std::cout << "depth: " << mcts_.GetTreeDepth() << std::endl;
         std::cout << "node in each depth: [";
@@ -216,7 +349,7 @@ void ReversiGame::SearchMove(bool place_stone)
         std::cout << "]" << std::endl;
         if (place_stone) {
             PlaceStone(move.first, move.second);
-        } else {
+        } else if (position_version_ == version) {
             hint_player_move = true;
             hint_move_pos = move;
         }
@@ -226,30 +359,61 @@ void ReversiGame::SearchMove(bool place_stone)
 
 void ReversiGame::WithdrawAMove()
 {
-    if (!is_player_turn_ || record_move_.empty()) {
+    if (!is_player_turn_ || !ai_think_finish || history_.CurrentPly() == 0) {
         return;
     }
     Stone player_stone = this_game_player_first ? Stone::BLACK : Stone::WHITE;
-    while (!record_board_state_.empty() && record_board_state_.back()[record_move_.back().first][record_move_.back().second] != player_stone) {
-        record_move_.pop_back();
-        record_board_state_.pop_back();
+    int ply = history_.CurrentPly() - 1;
+    while (ply > 0 && history_.GetMove(ply).place_stone != player_stone) {
+        --ply;
     }
-    if (!record_move_.empty()) {
-        record_move_.pop_back();
-        record_board_state_.pop_back();
+    JumpToPly(ply);
+}
+
+void ReversiGame::RedoAMove()
+{
+    if (!is_player_turn_ || !ai_think_finish || history_.CurrentPly() == history_.NumPlies()) {
+        return;
+    }
+    Stone player_stone = this_game_player_first ? Stone::BLACK : Stone::WHITE;
+    int ply = history_.CurrentPly() + 1;
+    while (ply < history_.NumPlies() && history_.GetMove(ply).place_stone != player_stone) {
+        ++ply;
     }
-    board_state_ = record_board_state_.back();
+    JumpToPly(ply);
+}
+
+/**
+ * Move the board to a ply of the history, the side to move is the one recorded at that ply.
+ */
+void ReversiGame::JumpToPly(int ply)
+{
+    // the pondered position is gone, its search would only hold the trees
+    mcts_.StopPondering();
+    ++position_version_;
+    history_.GoToPly(ply, board_state_);
+    Stone player_stone = this_game_player_first ? Stone::BLACK : Stone::WHITE;
+    next_move_stone_ = ply < history_.NumPlies() ? history_.GetMove(ply).place_stone : player_stone;
+    is_player_turn_ = next_move_stone_ == player_stone;
+    game_state_ = GameState::PLAYING;
+    game_over_popup_opened_once_ = false;
     hint_player_move = false;
     UpdateStoneCount();
     valid_moves_ = GetValidMoves(next_move_stone_, board_state_);
+    if (valid_moves_.empty()) {
+        GameConclude();
+        return;
+    }
+    StartPonderingOnPlayerTurn();
+    hint_text_ = is_player_turn_ ? hint_players_turn : hint_computer_turn;
     ResetIsMoveValid();
 }
 
 void ReversiGame::InitialGame()
 {
+    mcts_.StopPondering();
     game_state_ = GameState::PLAYING;
-    record_move_.clear();
-    record_board_state_.clear();
+    ++position_version_;
     board_state_.clear();
     board_state_ = std::vector<std::vector<Stone>>(board_size_, std::vector<Stone>(board_size_, Stone::EMPTY));
     // reset board state
@@ -270,90 +434,59 @@ void ReversiGame::InitialGame()
 
     ai_think_finish = true;
     hint_player_move = false;
-    record_board_state_.emplace_back(board_state_);
+    history_.Reset(board_state_);
     game_over_popup_opened_once_ = false;
+    StartPonderingOnPlayerTurn();
+}
+
+void ReversiGame::StartPonderingOnPlayerTurn()
+{
+    if (is_player_turn_ && ponder_) {
+        // the player's move will advance the root into the pondered subtree
+        mcts_.StartPondering(board_state_, next_move_stone_, ponder_iter_steps_);
+    }
 }
 
 
 std::vector<std::pair<int, int>> ReversiGame::GetValidMoves(Stone player_stone, const std::vector<std::vector<Stone>> &board_state)
 {
-    std::vector<std::pair<int, int>> valid_moves;
-    int board_size = static_cast<int>(board_state.size());
-    Stone opponent_stone = (player_stone == Stone::BLACK) ? Stone::WHITE : Stone::BLACK;
-    const std::vector<std::pair<int, int>> directions{
-        {-1, -1}, {-1, 0}, {-1, 1},
-        {0, -1},          {0, 1},
-        {1, -1},  {1, 0},  {1, 1}
-    };
-
-    for (int x = 0; x < board_size; ++x) {
-        for (int y = 0; y < board_size; ++y) {
-            if (board_state[x][y] != Stone::EMPTY) {
-                continue;
-            }
-            bool is_valid = false;
-            for (const auto &dir : directions) {
-                int nx = x + dir.first;
-                int ny = y + dir.second;
-                bool has_opponent_stone_between = false;
-                while (nx >= 0 && nx < board_size && ny >= 0 && ny < board_size) {
-                    if (board_state[nx][ny] == opponent_stone) {
-                        has_opponent_stone_between = true;
-                    } else if (board_state[nx][ny] == player_stone) {
-                        if (has_opponent_stone_between) {
-                            is_valid = true;
-                        }
-                        break;
-                    } else {
-                        break;
-                    }
-                    nx += dir.first;
-                    ny += dir.second;
-                }
-                if (is_valid) {
-                    valid_moves.emplace_back(x, y);
-                    break;
-                }
-            }
-        }
-    }
-    return valid_moves;
+    return DispatchBoardType(static_cast<int>(board_state.size()), [&](auto tag) {
+        using BoardType = typename decltype(tag)::type;
+        return ListValidMoves(BoardType::FromBoardState(board_state), player_stone);
+    });
 }
 
 Stone ReversiGame::GetOpponentStone(Stone stone)
 {
-    return stone == Stone::WHITE ? Stone::BLACK : Stone::WHITE;
+    return OpponentStone(stone);
 }
 
 void ReversiGame::UpdateBoardWithPlacementStone(std::vector<std::vector<Stone>> &board_state, int place_x, int place_y,
                                                 Stone place_stone)
 {
-    int board_sz = board_state.size();
-    board_state[place_x][place_y] = place_stone;
-    const std::vector<std::pair<int, int>> directions{
-        {-1, -1}, {-1, 0}, {-1, 1},
-        {0, -1},          {0, 1},
-        {1, -1},  {1, 0},  {1, 1}
-    };
-    Stone opp_stone = GetOpponentStone(place_stone);
-    for (auto &dir : directions) {
-        bool is_opp_between = false;
-        int pos_x = place_x + dir.first;
-        int pos_y = place_y + dir.second;
-        while (pos_x >= 0 && pos_x < board_sz && pos_y >= 0 && pos_y < board_sz
-               && board_state[pos_x][pos_y] == opp_stone) {
-            pos_x += dir.first;
-            pos_y += dir.second;
-        }
-        if (pos_x >= 0 && pos_x < board_sz && pos_y >= 0 && pos_y < board_sz
-            && board_state[pos_x][pos_y] == place_stone) {
-            while (pos_x != place_x || pos_y != place_y) {
-                board_state[pos_x][pos_y] = place_stone;
-                pos_x -= dir.first;
-                pos_y -= dir.second;
-            }
-        }
-    }
+    MakePlacementStone(board_state, place_x, place_y, place_stone);
+}
+
+PlacementDelta ReversiGame::MakePlacementStone(std::vector<std::vector<Stone>> &board_state,
+                                                            int place_x, int place_y, Stone place_stone)
+{
+    PlacementDelta delta;
+    delta.place_x = place_x;
+    delta.place_y = place_y;
+    delta.place_stone = place_stone;
+    delta.flips = DispatchBoardType(static_cast<int>(board_state.size()), [&](auto tag) {
+        using BoardType = typename decltype(tag)::type;
+        return ApplyPlacementStone(board_state, BoardType::FromBoardState(board_state), place_x, place_y, place_stone);
+    });
+    return delta;
+}
+
+Stone ReversiGame::GetGameWinner(const std::vector<std::vector<Stone>> &board_state)
+{
+    return DispatchBoardType(static_cast<int>(board_state.size()), [&](auto tag) {
+        using BoardType = typename decltype(tag)::type;
+        return BoardType::FromBoardState(board_state).GetWinner();
+    });
 }
 
 void ReversiGame::HintPlayerMove()
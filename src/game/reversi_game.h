@@ -4,6 +4,8 @@
 #include "game_ui.h"
 #include "game_const.h"
 #include "monte_carlo_tree_search.h"
+#include "multi_bitboard.h"
+#include "game_history.h"
 
 #include "imgui.h"
 #include "SDL.h"
@@ -36,6 +38,10 @@ public:
     static Stone GetOpponentStone(Stone stone);
     static void UpdateBoardWithPlacementStone(std::vector<std::vector<Stone>> &board_state, int place_x, int place_y, Stone place_stone);
 
+    // UnmakePlacementStone in game_history.h takes the placement back
+    static PlacementDelta MakePlacementStone(std::vector<std::vector<Stone>> &board_state, int place_x, int place_y, Stone place_stone);
+    static Stone GetGameWinner(const std::vector<std::vector<Stone>> &board_state);
+
     void HintPlayerMove();
 
     ~ReversiGame() {
@@ -70,6 +76,9 @@ private:
 
     void SearchMove(bool place_stone = true);
     void WithdrawAMove();
+    void RedoAMove();
+    void JumpToPly(int ply);
+    void StartPonderingOnPlayerTurn();
 
     YAML::Node config;
 
@@ -83,8 +92,7 @@ private:
     bool this_game_player_first = true;
     GameState game_state_ = GameState::PLAYING;
 
-    std::vector<std::pair<int,int>> record_move_;
-    std::vector<decltype(board_state_)> record_board_state_;
+    GameHistory history_;
 
     std::string hint_text_;
 
@@ -98,8 +106,13 @@ private:
     const std::string hint_player_loss = "You loss";  
     
     MonteCarloTreeSearch mcts_;
+    MonteCarloTreeSearch::Options mcts_options_;
     std::atomic<bool> ai_think_finish = true;
+    std::atomic<int> position_version_ = 0; // bumped on every position change, a hint of an older one is dropped
     int monte_carlo_iter_steps_ = 60000;
+    int think_time_ms_ = 0; // time budget of one AI move, 0 runs monte_carlo_iter_steps_ simulations instead
+    bool ponder_ = false; // search the player's position while they think
+    int ponder_iter_steps_ = 600000; // bounds the tree grown while the player takes their time
     std::vector<std::thread> ai_think_threads_;
 
     bool hint_player_move = false;
@@ -0,0 +1,94 @@
+#ifndef __ZOBRIST_H__
+#define __ZOBRIST_H__
+
+#include "game_const.h"
+
+#include <cstdint>
+
+/**
+ * Zobrist keys shared by every position type. Square indices are the bit indices of the
+ * position, the board size is mixed in so the same discs on different sizes hash apart.
+ */
+namespace zobrist {
+    constexpr int max_board_size = 32;
+    constexpr int max_squares = max_board_size * max_board_size;
+
+    struct Keys {
+        uint64_t stones[2][max_squares] = {}; // [0] black, [1] white
+        uint64_t flips[max_squares] = {};     // stones[0][i] ^ stones[1][i], a disc changing color
+        uint64_t sizes[max_board_size + 1] = {};
+        uint64_t white_to_move = 0;
+    };
+
+    constexpr uint64_t SplitMix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    constexpr Keys MakeKeys()
+    {
+        Keys result;
+        uint64_t state = 0x5EED0F0E11057ull;
+        for (int square = 0; square < max_squares; ++square) {
+            result.stones[0][square] = SplitMix64(state);
+            result.stones[1][square] = SplitMix64(state);
+            result.flips[square] = result.stones[0][square] ^ result.stones[1][square];
+        }
+        for (int size = 0; size <= max_board_size; ++size) {
+            result.sizes[size] = SplitMix64(state);
+        }
+        result.white_to_move = SplitMix64(state);
+        return result;
+    }
+
+    inline constexpr Keys keys = MakeKeys();
+
+    /**
+     * bytes[j][v] is the XOR of keys.flips over the bits set in v << (8 * j), a flip mask of a single
+     * word board is hashed with eight lookups instead of one per flipped disc.
+     */
+    struct FlipByteKeys {
+        uint64_t bytes[8][256] = {};
+    };
+
+    constexpr FlipByteKeys MakeFlipByteKeys()
+    {
+        FlipByteKeys result;
+        for (int j = 0; j < 8; ++j) {
+            for (int value = 0; value < 256; ++value) {
+                for (int bit = 0; bit < 8; ++bit) {
+                    if ((value >> bit) & 1) {
+                        result.bytes[j][value] ^= keys.flips[j * 8 + bit];
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    inline constexpr FlipByteKeys flip_byte_keys = MakeFlipByteKeys();
+
+    inline uint64_t FlipsKey(uint64_t flips)
+    {
+        const auto &bytes = flip_byte_keys.bytes;
+        return bytes[0][flips & 255] ^ bytes[1][(flips >> 8) & 255]
+            ^ bytes[2][(flips >> 16) & 255] ^ bytes[3][(flips >> 24) & 255]
+            ^ bytes[4][(flips >> 32) & 255] ^ bytes[5][(flips >> 40) & 255]
+            ^ bytes[6][(flips >> 48) & 255] ^ bytes[7][flips >> 56];
+    }
+
+    inline uint64_t StoneKey(Stone stone, int square)
+    {
+        return keys.stones[stone == Stone::WHITE ? 1 : 0][square];
+    }
+
+    inline uint64_t SideKey(Stone next_move_stone)
+    {
+        return next_move_stone == Stone::WHITE ? keys.white_to_move : 0;
+    }
+}
+
+#endif